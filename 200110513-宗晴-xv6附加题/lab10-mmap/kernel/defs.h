@@ -51,6 +51,7 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
+int             readblocks(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
 void            itrunc(struct inode*);
@@ -70,6 +71,17 @@ void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            begin_opn(int);
+void            end_opn(int);
+
+// pcache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint);
+char*           pclookup(struct inode*, uint);
+void            pcdup(uint64);
+void            pcput(uint64);
+void            pcwrite(struct inode*, uint, uchar*, uint);
+void            pcinval(struct inode*);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -147,7 +159,7 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
-struct VMA *    vma_check(struct proc *, uint64);
+void            vmapopulate(struct proc*, struct VMA*, uint64, uint64, int);
 int             lazy_allocation(uint64);
 
 // uart.c
@@ -170,10 +182,13 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t*          walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            vmawriteback(pagetable_t, uint64, uint64, struct VMA *);
 void            vmaunmap(pagetable_t, uint64, uint64, struct VMA *);
 
 // plic.c
@@ -182,6 +197,18 @@ void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
 
+// vma.c
+void            vmainit(void);
+struct VMA*     vmaalloc(void);
+void            vmafree(struct VMA*);
+struct VMA*     vma_check(struct proc*, uint64);
+struct VMA*     vmalowest(struct proc*);
+void            vmainsert(struct proc*, struct VMA*);
+struct VMA*     vmasplit(struct proc*, struct VMA*, uint64);
+int             vmaremove(struct proc*, uint64, uint64);
+int             vmadup(struct proc*, struct proc*);
+void            vmaclear(struct proc*);
+
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
@@ -8,12 +8,14 @@
 #include "elf.h"
 
 static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
+static uint shareseg(pagetable_t, uint64, struct inode *, uint, uint);
 
 int
 exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
+  uint n;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
   struct inode *ip;
@@ -48,13 +50,22 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    if(ph.vaddr % PGSIZE != 0 || ph.vaddr < PGROUNDUP(sz))
+      goto bad;
     uint64 sz1;
+    if(ph.vaddr > PGROUNDUP(sz)){
+      if((sz1 = uvmalloc(pagetable, sz, ph.vaddr)) == 0)
+        goto bad;
+      sz = sz1;
+    }
+    // 文件中的整页映射页缓存中的共享页，其余部分读入私有页
+    n = shareseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz);
+    if(n > 0)
+      sz = ph.vaddr + n;
     if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     sz = sz1;
-    if(ph.vaddr % PGSIZE != 0)
-      goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(loadseg(pagetable, ph.vaddr + n, ip, ph.off + n, ph.filesz - n) < 0)
       goto bad;
   }
   iunlockput(ip);
@@ -155,3 +166,28 @@ loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz
   
   return 0;
 }
+
+// Map the whole pages of a program segment that lie within
+// the file as read-only pages from the page cache, shared by
+// every process running this binary.  va must be page-aligned.
+// Stops early if the cache is full or offset is not page-aligned.
+// Returns the number of bytes mapped.
+static uint
+shareseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
+{
+  uint i;
+  char *pa;
+
+  if((offset % PGSIZE) != 0)
+    return 0;
+
+  for(i = 0; i + PGSIZE <= sz; i += PGSIZE){
+    if((pa = pcget(ip, offset + i)) == 0)
+      break;
+    if(mappages(pagetable, va + i, PGSIZE, (uint64)pa, PTE_R|PTE_X|PTE_U|PTE_PC|PTE_COW) != 0){
+      pcput((uint64)pa);
+      break;
+    }
+  }
+  return i;
+}
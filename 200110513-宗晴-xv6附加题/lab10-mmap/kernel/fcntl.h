@@ -12,4 +12,14 @@
 
 #define MAP_SHARED      0x01
 #define MAP_PRIVATE     0x02
+#define MAP_POPULATE    0x08000
+
+#define MS_ASYNC        1
+#define MS_INVALIDATE   2
+#define MS_SYNC         4
+
+#define MADV_NORMAL     0
+#define MADV_RANDOM     1
+#define MADV_SEQUENTIAL 2
+#define MADV_WILLNEED   3
 #endif
@@ -20,6 +20,7 @@ struct inode {
   int ref;            // Reference count
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
+  int pcached;        // 页缓存中可能有该文件的页
 
   short type;         // copy of disk inode
   short major;
@@ -307,6 +307,7 @@ ilock(struct inode *ip)
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
     ip->valid = 1;
+    ip->pcached = 1;  // 之前缓存的页可能还在页缓存中
     if(ip->type == 0)
       panic("ilock: no type");
   }
@@ -413,6 +414,9 @@ itrunc(struct inode *ip)
   struct buf *bp;
   uint *a;
 
+  if(ip->pcached)
+    pcinval(ip);
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -452,8 +456,43 @@ stati(struct inode *ip, struct stat *st)
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// Regular files are read through the page cache, so read(),
+// mmap and exec share one copy of each file page.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
+{
+  uint tot, m;
+  char *pa;
+  int r;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+  if(ip->type != T_FILE)
+    return readblocks(ip, user_dst, dst, off, n);
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    if((pa = pcget(ip, PGROUNDDOWN(off))) == 0){
+      // 页缓存已满，直接经由块缓存读
+      if(readblocks(ip, user_dst, dst, off, m) != m)
+        return -1;
+      continue;
+    }
+    r = either_copyout(user_dst, dst, pa + off%PGSIZE, m);
+    pcput((uint64)pa);
+    if(r == -1)
+      return -1;
+  }
+  return tot;
+}
+
+// Read data from inode through the buffer cache only.
+// Used by readi and to fill page cache pages.
+// Caller must hold ip->lock.
+int
+readblocks(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
@@ -501,6 +540,8 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
       brelse(bp);
       break;
     }
+    if(ip->pcached)
+      pcwrite(ip, off, bp->data + (off % BSIZE), m);
     log_write(bp);
     brelse(bp);
   }
@@ -42,6 +42,7 @@ struct log {
   int start;
   int size;
   int outstanding; // how many FS sys calls are executing.
+  int reserved;    // log blocks reserved by those calls.
   int committing;  // in commit(), please wait.
   int dev;
   struct logheader lh;
@@ -126,15 +127,27 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  begin_opn(MAXOPBLOCKS);
+}
+
+// like begin_op(), but for an operation that may write up to
+// n blocks (at most LOGSIZE-1), such as a batch of page writebacks.
+// must be paired with end_opn(n).
+void
+begin_opn(int n)
+{
+  if(n > LOGSIZE - 1)
+    panic("begin_opn");
   acquire(&log.lock);
   while(1){
     if(log.committing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + log.reserved + n > LOGSIZE){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      log.reserved += n;
       release(&log.lock);
       break;
     }
@@ -145,11 +158,18 @@ begin_op(void)
 // commits if this was the last outstanding operation.
 void
 end_op(void)
+{
+  end_opn(MAXOPBLOCKS);
+}
+
+void
+end_opn(int n)
 {
   int do_commit = 0;
 
   acquire(&log.lock);
   log.outstanding -= 1;
+  log.reserved -= n;
   if(log.committing)
     panic("log.committing");
   if(log.outstanding == 0){
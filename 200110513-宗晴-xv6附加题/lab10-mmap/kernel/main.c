@@ -26,6 +26,8 @@ main()
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
     iinit();         // inode cache
+    pcinit();        // page cache
+    vmainit();       // mmap areas
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
@@ -8,6 +8,8 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NBUF         (LOGSIZE+MAXOPBLOCKS*2)  // size of disk block cache, beyond pinned log blocks
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NPCACHE      128   // unmapped pages kept in the file page cache
+#define FAULTAROUND  16    // pages mapped around an mmap page fault
@@ -0,0 +1,322 @@
+// Page cache.
+//
+// The page cache holds whole 4096-byte pages of regular file
+// content, keyed by (dev, inum, page-aligned offset).  It is the
+// single in-memory copy of a file page: readi copies out of it,
+// exec maps it read-only into every process running the same
+// binary, and mmap faults map it directly (MAP_SHARED) or
+// read-only until the first write (MAP_PRIVATE).
+//
+// Interface:
+// * To get a cached page of a file, call pcget with the inode
+//     locked; it returns the page's physical address with one
+//     more reference, or 0 if memory is exhausted.
+// * Each page table entry that maps a cached page holds one
+//     reference and carries PTE_PC; pcdup adds one, pcput drops it.
+// * writei passes every write to pcwrite, which updates a cached
+//     copy in place; itrunc calls pcinval so that later lookups
+//     do not find pages of the old content.
+// * Mapped pages are never evicted, so every mapping of a file
+//     page sees the same physical page; the cache grows with them.
+//     Up to NPCACHE pages with no references stay cached, and the
+//     least recently used of those is reused first.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+
+#define NPCHASH 61
+#define PCHASH(dev, inum, off) (((dev) * 31 + (inum) * 17 + (off) / PGSIZE) % NPCHASH)
+#define PAHASH(pa) (((pa) / PGSIZE) % NPCHASH)
+
+struct pcpage {
+  uint dev;
+  uint inum;             // 0 表示该页不再对应任何文件页
+  uint off;              // 页在文件中的偏移，按页对齐
+  int ref;               // 映射该页的页表项数
+  char *data;            // 物理页
+  struct pcpage *next;   // (dev, inum, off) 哈希链
+  struct pcpage *pnext;  // 物理地址哈希链
+  struct pcpage *lprev;  // 无人映射的页的LRU链
+  struct pcpage *lnext;
+};
+
+struct {
+  struct spinlock lock;
+  struct pcpage *hash[NPCHASH];
+  struct pcpage *pahash[NPCHASH];
+
+  // 无人映射但仍缓存着的页，lru.lnext最久未用
+  struct pcpage lru;
+  int nidle;             // lru链上的页数
+  struct pcpage *freelist;  // 空闲的pcpage结构，经由next链接
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.lru.lprev = &pcache.lru;
+  pcache.lru.lnext = &pcache.lru;
+}
+
+// 以下函数的调用者须持有pcache.lock。
+
+// 把页从 (dev, inum, off) 哈希链上摘下。
+static void
+pcunhash(struct pcpage *pg)
+{
+  struct pcpage **pp;
+
+  for(pp = &pcache.hash[PCHASH(pg->dev, pg->inum, pg->off)]; *pp; pp = &(*pp)->next){
+    if(*pp == pg){
+      *pp = pg->next;
+      break;
+    }
+  }
+  pg->inum = 0;
+}
+
+static void
+lruremove(struct pcpage *pg)
+{
+  pg->lprev->lnext = pg->lnext;
+  pg->lnext->lprev = pg->lprev;
+  pcache.nidle--;
+}
+
+static void
+lruappend(struct pcpage *pg)
+{
+  pg->lprev = pcache.lru.lprev;
+  pg->lnext = &pcache.lru;
+  pcache.lru.lprev->lnext = pg;
+  pcache.lru.lprev = pg;
+  pcache.nidle++;
+}
+
+// 取出最久未用的无人映射的页，用于缓存另一个文件页
+static struct pcpage*
+pcreclaim(void)
+{
+  struct pcpage *pg = pcache.lru.lnext;
+
+  if(pg == &pcache.lru)
+    return 0;
+  lruremove(pg);
+  if(pg->inum)
+    pcunhash(pg);
+  return pg;
+}
+
+// 分配一个带物理页的pcpage
+static struct pcpage*
+pcalloc(void)
+{
+  struct pcpage *pg;
+  char *mem;
+
+  if(pcache.freelist == 0){
+    // 取一页切分成若干个pcpage
+    if((mem = kalloc()) == 0)
+      return 0;
+    for(pg = (struct pcpage*)mem; pg + 1 <= (struct pcpage*)(mem + PGSIZE); pg++){
+      pg->next = pcache.freelist;
+      pcache.freelist = pg;
+    }
+  }
+  pg = pcache.freelist;
+  if((pg->data = kalloc()) == 0)
+    return 0;
+  pcache.freelist = pg->next;
+  pg->pnext = pcache.pahash[PAHASH((uint64)pg->data)];
+  pcache.pahash[PAHASH((uint64)pg->data)] = pg;
+  return pg;
+}
+
+// 释放一个不在哈希链和LRU链上的页
+static void
+pcfree(struct pcpage *pg)
+{
+  struct pcpage **pp;
+
+  for(pp = &pcache.pahash[PAHASH((uint64)pg->data)]; *pp; pp = &(*pp)->pnext){
+    if(*pp == pg){
+      *pp = pg->pnext;
+      break;
+    }
+  }
+  kfree(pg->data);
+  pg->data = 0;
+  pg->next = pcache.freelist;
+  pcache.freelist = pg;
+}
+
+static struct pcpage*
+pcfind(uint64 pa)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.pahash[PAHASH(pa)]; pg; pg = pg->pnext)
+    if((uint64)pg->data == pa)
+      return pg;
+  panic("pcfind");
+}
+
+// 在哈希链上查找文件页，找到则增加引用
+static struct pcpage*
+pclookup1(struct inode *ip, uint off)
+{
+  struct pcpage *pg;
+
+  for(pg = pcache.hash[PCHASH(ip->dev, ip->inum, off)]; pg; pg = pg->next){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->off == off){
+      if(pg->ref++ == 0)
+        lruremove(pg);
+      return pg;
+    }
+  }
+  return 0;
+}
+
+// Return the physical address of the cached page holding the
+// file content of ip at page-aligned offset off, reading it in
+// if necessary.  Bytes past the end of the file are zero.
+// Returns 0 if memory is exhausted and no unmapped page can be
+// reused.
+// Caller must hold ip->lock, which also keeps two processes
+// from reading in the same page at once.
+char*
+pcget(struct inode *ip, uint off)
+{
+  struct pcpage *pg;
+  int h;
+
+  acquire(&pcache.lock);
+  if((pg = pclookup1(ip, off)) != 0){
+    release(&pcache.lock);
+    return pg->data;
+  }
+
+  // 未命中：无人映射的页已够多时替换最久未用的，否则新分配一页
+  pg = 0;
+  if(pcache.nidle >= NPCACHE)
+    pg = pcreclaim();
+  if(pg == 0 && (pg = pcalloc()) == 0 && (pg = pcreclaim()) == 0){
+    release(&pcache.lock);
+    return 0;
+  }
+  h = PCHASH(ip->dev, ip->inum, off);
+  pg->dev = ip->dev;
+  pg->inum = ip->inum;
+  pg->off = off;
+  pg->ref = 1;
+  pg->next = pcache.hash[h];
+  pcache.hash[h] = pg;
+  release(&pcache.lock);
+
+  ip->pcached = 1;
+  memset(pg->data, 0, PGSIZE);
+  readblocks(ip, 0, (uint64)pg->data, off, PGSIZE);
+  return pg->data;
+}
+
+// Like pcget, but only return a page that is already cached,
+// without reading from disk.  Returns 0 if it is not.
+// Caller must hold ip->lock.
+char*
+pclookup(struct inode *ip, uint off)
+{
+  struct pcpage *pg;
+
+  acquire(&pcache.lock);
+  pg = pclookup1(ip, off);
+  release(&pcache.lock);
+  return pg ? pg->data : 0;
+}
+
+// Add a reference to the cached page at pa.
+void
+pcdup(uint64 pa)
+{
+  acquire(&pcache.lock);
+  pcfind(pa)->ref++;
+  release(&pcache.lock);
+}
+
+// Drop a reference to the cached page at pa.  A page that is
+// no longer mapped stays cached, unless pcinval dropped it from
+// its file or there are already NPCACHE such pages.
+void
+pcput(uint64 pa)
+{
+  struct pcpage *pg;
+
+  acquire(&pcache.lock);
+  pg = pcfind(pa);
+  if(pg->ref < 1)
+    panic("pcput");
+  if(--pg->ref == 0){
+    if(pg->inum == 0){
+      pcfree(pg);
+    } else {
+      lruappend(pg);
+      if(pcache.nidle > NPCACHE)
+        pcfree(pcreclaim());
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Copy n bytes just written to ip at off into the cached page
+// holding them, if any.  The range must lie within one page.
+// Caller must hold ip->lock.
+void
+pcwrite(struct inode *ip, uint off, uchar *src, uint n)
+{
+  struct pcpage *pg;
+  uint pgoff = PGROUNDDOWN(off);
+
+  acquire(&pcache.lock);
+  for(pg = pcache.hash[PCHASH(ip->dev, ip->inum, pgoff)]; pg; pg = pg->next){
+    if(pg->dev == ip->dev && pg->inum == ip->inum && pg->off == pgoff){
+      memmove(pg->data + (off - pgoff), src, n);
+      break;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Drop all cached pages of ip.  Pages still mapped by some
+// process keep their old content until the last reference
+// goes away, but are no longer found by pcget.
+// Caller must hold ip->lock.
+void
+pcinval(struct inode *ip)
+{
+  struct pcpage *pg, **pp;
+  int h;
+
+  acquire(&pcache.lock);
+  for(h = 0; h < NPCHASH; h++){
+    for(pp = &pcache.hash[h]; (pg = *pp) != 0; ){
+      if(pg->inum != ip->inum || pg->dev != ip->dev){
+        pp = &pg->next;
+        continue;
+      }
+      *pp = pg->next;
+      pg->inum = 0;
+      if(pg->ref == 0){
+        lruremove(pg);
+        pcfree(pg);
+      }
+    }
+  }
+  release(&pcache.lock);
+  ip->pcached = 0;
+}
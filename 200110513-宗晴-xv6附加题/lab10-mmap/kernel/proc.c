@@ -134,10 +134,7 @@ found:
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
 
-  // 初始化vma数组
-  for(int i=0; i<VMASZ; i++) {
-    p->vma[i].valid = 0;
-  }
+  p->vmas = 0;
 
   return p;
 }
@@ -152,11 +149,6 @@ freeproc(struct proc *p)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
 
-  for(int i = 0; i < VMASZ; i++) {
-    struct VMA *vma = &p->vma[i];
-    vmaunmap(p->pagetable, vma->start_addr, vma->length, vma);
-  }
-
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -293,6 +285,12 @@ fork(void)
   }
   np->sz = p->sz;
 
+  if(vmadup(np, p) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
   np->parent = p;
 
   // copy saved user registers.
@@ -307,17 +305,6 @@ fork(void)
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
 
-  // 子进程拷贝父进程所有有效的vma
-  // 并将对应文件的被引用次数加一
-  // 但不拷贝实际的物理页和目录项
-  for(i = 0; i < VMASZ; i++) {
-    struct VMA *vma = &p->vma[i];
-    if(vma->valid) {
-      np->vma[i] = *vma;
-      filedup(vma->fp);
-    }
-  }
-
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
@@ -366,6 +353,9 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // 解除所有映射，写回共享映射的脏页
+  vmaclear(p);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
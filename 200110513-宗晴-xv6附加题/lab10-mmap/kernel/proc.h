@@ -87,13 +87,14 @@ struct VMA {
   uint64 length;      // 文件大小
   int prot;           // 权限
   struct file* fp;    // 指向map的文件
-  int valid;          // 该VMA是否有效
   int flags;          // map的标志位
   uint64 offset;      // 映射的文件的起始地址
+  int advice;         // madvise设置的访问方式
+  struct VMA *left;   // 按start_addr排序的AVL树
+  struct VMA *right;
+  int height;         // 子树高度
 };
 
-#define VMASZ 16
-
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -115,7 +116,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-  struct VMA vma[VMASZ];       // 固定大小的VMA数组，按需从数组中分配
+  struct VMA *vmas;            // VMA树的根
 };
 
 
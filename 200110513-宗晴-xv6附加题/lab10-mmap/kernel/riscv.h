@@ -332,6 +332,8 @@ sfence_vma()
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
 #define PTE_D (1L << 7) // dirty
+#define PTE_PC (1L << 8) // 映射的是页缓存中的共享页
+#define PTE_COW (1L << 9) // 只读的共享页，写时复制后可写
 
 // shift a physical address to the right place for a PTE.
 #define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
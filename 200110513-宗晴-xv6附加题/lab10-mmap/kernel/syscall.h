@@ -22,3 +22,5 @@
 #define SYS_close  21
 #define SYS_mmap   22
 #define SYS_munmap 23
+#define SYS_madvise 24
+#define SYS_msync  25
@@ -496,35 +496,32 @@ sys_mmap(void)
   if(argaddr(0, &addr) < 0 || argaddr(1, &sz) < 0 || argint(2, &prot) < 0
     || argint(3, &flags) < 0 || argfd(4, &fd, &fp) < 0 || argaddr(5, &offset) < 0 || sz == 0)
     return -1;
-  // 判断文件权限是否正确
+  // 判断文件权限是否正确，不支持PROT_NONE的映射
+  if((prot & (PROT_READ|PROT_WRITE|PROT_EXEC)) == 0)
+    return -1;
+  // 文件偏移须按页对齐，以便映射页缓存中的页
+  if(offset % PGSIZE != 0)
+    return -1;
   if((!fp->readable && (prot & (PROT_READ)))
      || (!fp->writable && (prot & PROT_WRITE) && !(flags & MAP_PRIVATE)))
     return -1;
   
   sz = PGROUNDUP(sz);
   struct proc *p = myproc();
-  struct VMA *vma = 0;
-  // 选取heap中最顶端（即最靠近trapframe）的部分用于映射文件
+  struct VMA *vma, *low;
+  // 选取heap中最顶端（即最靠近trapframe）的部分用于映射文件，
+  // 即当前所有vma的最低地址之下
   uint64 min_addr = TRAPFRAME;
-  // 查找空闲的vma，并计算当前所有vma的最低地址
-  for(int i=0;i<VMASZ;i++) {
-    struct VMA *cur_vma = &p->vma[i];
-    if(cur_vma->valid == 0) {
-      // 找到空闲vma
-      if(vma == 0) {
-        vma = &p->vma[i];
-        vma->valid = 1;
-      }
-    } else if(cur_vma->start_addr < min_addr) {
-      min_addr = PGROUNDDOWN(cur_vma->start_addr);
-    }
-  }
-  if(vma == 0){
-    printf("mmap: no free vma left\n");
-  }
-  
+  if((low = vmalowest(p)) != 0)
+    min_addr = PGROUNDDOWN(low->start_addr);
+  if(min_addr < sz || min_addr - sz < PGROUNDUP(p->sz))
+    return -1;
+  if((vma = vmaalloc()) == 0)
+    return -1;
+
   // 初始化vma中的属性
-  vma->start_addr = min_addr - sz;
+  uint64 start = min_addr - sz;
+  vma->start_addr = start;
   vma->length = sz;
   vma->prot = prot;
   vma->flags = flags;
@@ -534,7 +531,14 @@ sys_mmap(void)
   // 将所指向的文件的被引用次数加一
   filedup(vma->fp);
 
-  return vma->start_addr;
+  // 插入VMA树，可能与相邻的映射合并
+  vmainsert(p, vma);
+
+  // MAP_POPULATE：立即读入并映射整个区域
+  if(flags & MAP_POPULATE)
+    vmapopulate(p, vma_check(p, start), start, start + sz, 1);
+
+  return start;
 }
 
 uint64
@@ -546,39 +550,81 @@ sys_munmap(void)
     return -1;
 
   struct proc *p = myproc();
-  // 判断是否是vma，找到对应的vma结构体
-  struct VMA *vma = vma_check(p, addr);
-  if(vma == 0) {
+  // 判断是否是vma，地址须按页对齐
+  if(addr % PGSIZE != 0 || vma_check(p, addr) == 0) {
     return -1;
   }
-  // 判断地址是否在规定返回内，即避免在内存中间dig a hole的情况
-  if(addr > vma->start_addr && addr + sz < vma->start_addr + vma->length) {
+  if(addr + sz < addr)
     return -1;
-  }
 
-  // 将地址与页大小对齐
-  uint64 addr_aligned = addr;
-  if(addr > vma->start_addr) {
-    addr_aligned = PGROUNDUP(addr);
-  }
-  // 计算需要unmap的大小
-  int unmap_sz = sz - (addr_aligned-addr);
-  if(unmap_sz < 0)
-    unmap_sz = 0;
-  // 删除映射并写回数据
-  vmaunmap(p->pagetable, addr_aligned, unmap_sz, vma);
-  // 修改相关的属性值
-  if(addr <= vma->start_addr && addr + sz > vma->start_addr) {
-    vma->offset += addr + sz - vma->start_addr;
-    vma->start_addr = addr + sz;
-  }
-  vma->length -= sz;
+  // 删除[addr, addr+sz)内的映射并写回数据，可从vma中间挖去一段；
+  // 某个vma的所有页都被释放时，关闭对文件的引用
+  return vmaremove(p, addr, PGROUNDUP(sz));
+}
+uint64
+sys_madvise(void)
+{
+  uint64 addr, sz, end;
+  int advice;
+  // 从寄存器中获取所需参数
+  if(argaddr(0, &addr) < 0 || argaddr(1, &sz) < 0 || argint(2, &advice) < 0)
+    return -1;
+  if(addr % PGSIZE != 0 || addr + sz < addr)
+    return -1;
+  if(advice < MADV_NORMAL || advice > MADV_WILLNEED)
+    return -1;
 
-  // 若所有页都被释放，则关闭对文件的引用
-  if(vma->length <= 0) {
-    fileclose(vma->fp);
-    vma->valid = 0;
+  struct proc *p = myproc();
+  end = PGROUNDUP(addr + sz);
+  // 依次处理与[addr, end)相交的每个vma
+  while(addr < end) {
+    struct VMA *vma = vma_check(p, addr);
+    if(vma == 0)
+      return -1;
+    if(advice == MADV_WILLNEED) {
+      // 立即读入并映射该范围
+      vmapopulate(p, vma, addr, end, 1);
+    } else if(vma->advice != advice) {
+      // 访问方式记录在vma上，范围只覆盖vma的一部分时先拆分
+      if(addr > vma->start_addr && (vma = vmasplit(p, vma, addr)) == 0)
+        return -1;
+      if(end < vma->start_addr + vma->length && vmasplit(p, vma, end) == 0)
+        return -1;
+      vma->advice = advice;
+    }
+    addr = vma->start_addr + vma->length;
   }
+  return 0;
+}
 
-  return 0;  
-}
\ No newline at end of file
+uint64
+sys_msync(void)
+{
+  uint64 addr, sz, end;
+  int flags;
+  // 从寄存器中获取所需参数
+  if(argaddr(0, &addr) < 0 || argaddr(1, &sz) < 0 || argint(2, &flags) < 0)
+    return -1;
+  if(addr % PGSIZE != 0 || addr + sz < addr)
+    return -1;
+  if((flags & ~(MS_ASYNC|MS_INVALIDATE|MS_SYNC))
+     || ((flags & MS_ASYNC) && (flags & MS_SYNC)))
+    return -1;
+
+  struct proc *p = myproc();
+  end = PGROUNDUP(addr + sz);
+  // 写回与[addr, end)相交的每个共享映射中的脏页。
+  // 日志提交是同步的，MS_ASYNC与MS_SYNC效果相同；
+  // 页缓存是文件内容的唯一副本，MS_INVALIDATE无需处理
+  while(addr < end) {
+    struct VMA *vma = vma_check(p, addr);
+    if(vma == 0)
+      return -1;
+    uint64 e = vma->start_addr + vma->length;
+    if(e > end)
+      e = end;
+    vmawriteback(p->pagetable, addr, e - addr, vma);
+    addr = e;
+  }
+  return 0;
+}
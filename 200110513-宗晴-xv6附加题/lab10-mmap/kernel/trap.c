@@ -73,7 +73,9 @@ usertrap(void)
     // ok
   } else {
     uint64 va = r_stval();
-    if(r_scause() == 13 || r_scause() == 15){  // 缺页异常
+    if(r_scause() == 15 && uvmcow(p->pagetable, PGROUNDDOWN(va)) == 0){
+      // 写页缓存中的共享页，已换成私有拷贝
+    } else if(r_scause() == 13 || r_scause() == 15){  // 缺页异常
       if(!lazy_allocation(va)) {
         goto err;
       }
@@ -233,19 +235,76 @@ devintr()
 }
 
 
-// 判断该缺页异常是否是由vma懒分配导致的
-struct VMA *vma_check(struct proc *p, uint64 va) {
-  for(int i=0;i<VMASZ;i++) {
-    struct VMA *vma = &p->vma[i];
-    if(vma->valid == 1  // vma有效
-        && va >= vma->start_addr  // 虚拟地址在规定范围内
-        && va < vma->start_addr + vma->length) {
-      return vma;
-    }
+
+
+// 建立vma中va处一页的映射，已映射则直接返回。
+// fill为0时只映射已在页缓存中的页，不读磁盘。
+// Caller must hold the lock of vma->fp->ip.
+// 成功返回0，否则返回-1
+static int vmamap(struct proc *p, struct VMA *vma, uint64 va, int fill) {
+  struct inode *ip = vma->fp->ip;
+  uint off = vma->offset + (va - vma->start_addr);
+  pte_t *pte;
+
+  if((pte = walk(p->pagetable, va, 0)) != 0 && (*pte & PTE_V))
+    return 0;
+
+  // 设置权限
+  int perm = PTE_U;
+  if(vma->prot & PROT_READ)
+    perm |= PTE_R;
+  if(vma->prot & PROT_WRITE)
+    perm |= PTE_W | PTE_R;  // RISC-V没有只写的页表项
+  if(vma->prot & PROT_EXEC)
+    perm |= PTE_X;
+
+  // 优先使用页缓存中的页：共享映射直接映射同一物理页，
+  // 私有映射先只读映射，写时再复制
+  void *pa = 0;
+  if(vma->offset % PGSIZE == 0)
+    pa = fill ? pcget(ip, off) : pclookup(ip, off);
+  if(pa) {
+    if(!(vma->flags & MAP_SHARED) && (perm & PTE_W))
+      perm = (perm & ~PTE_W) | PTE_COW;
+    perm |= PTE_PC;
+  } else {
+    // 共享映射必须使用页缓存中的页，否则各进程看不到彼此的写入
+    if(!fill || (vma->flags & MAP_SHARED))
+      return -1;
+    // 内存不足，私有映射退而读入私有页
+    if((pa = kalloc()) == 0)
+      return -1;
+    memset(pa, 0, PGSIZE);
+    readi(ip, 0, (uint64)pa, off, PGSIZE);
+  }
+
+  // 建立映射
+  if(mappages(p->pagetable, va, PGSIZE, (uint64)pa, perm) < 0) {
+    if(perm & PTE_PC)
+      pcput((uint64)pa);
+    else
+      kfree(pa);
+    return -1;
   }
   return 0;
 }
 
+// 在一次加锁中映射vma内[start, end)的所有页，
+// fill为0时只映射已在页缓存中的页
+void vmapopulate(struct proc *p, struct VMA *vma, uint64 start, uint64 end, int fill) {
+  struct inode *ip = vma->fp->ip;
+
+  start = PGROUNDDOWN(start);
+  if(start < vma->start_addr)
+    start = vma->start_addr;
+  if(end > vma->start_addr + vma->length)
+    end = vma->start_addr + vma->length;
+
+  ilock(ip);
+  for(uint64 a = start; a < end; a += PGSIZE)
+    vmamap(p, vma, a, fill);
+  iunlock(ip);
+}
 
 int lazy_allocation(uint64 va) {
   struct proc *p = myproc();
@@ -256,37 +315,42 @@ int lazy_allocation(uint64 va) {
     return 0;
   }
 
+  // 页已映射却仍出错，说明访问违反了映射的权限
+  // (如写PROT_READ的映射)，应杀死进程
+  va = PGROUNDDOWN(va);
+  pte_t *pte = walk(p->pagetable, va, 0);
+  if(pte && (*pte & PTE_V)) {
+    return 0;
+  }
+
   // 若是由vma懒分配导致的，则需要给其分配内存空间，
   // 并从磁盘中读取数据
-
-  // 分配内存空间
-  void *pa = kalloc();
-  if(pa == 0) {
-    panic("lazy_allocation: failed to kalloc");
+  uint64 start, end;
+  if(vma->advice == MADV_SEQUENTIAL) {
+    // 顺序访问：把后面一个窗口的页一并读入
+    start = va;
+    end = va + FAULTAROUND*PGSIZE;
+  } else {
+    // 顺带映射所在对齐窗口内已在页缓存中的页
+    start = va & ~((uint64)FAULTAROUND*PGSIZE - 1);
+    end = start + FAULTAROUND*PGSIZE;
   }
-  memset(pa, 0, PGSIZE);
-  
-  // 从磁盘中读取数据
-  begin_op();
-  ilock(vma->fp->ip);
-  readi(vma->fp->ip, 0, (uint64)pa, vma->offset
-        + PGROUNDDOWN(va - vma->start_addr), PGSIZE);
-  iunlock(vma->fp->ip);
-  end_op();
 
-  // 设置权限
-  int perm = PTE_U;
-  if(vma->prot & PROT_READ)
-    perm |= PTE_R;
-  if(vma->prot & PROT_WRITE)
-    perm |= PTE_W;
-  if(vma->prot & PROT_EXEC)
-    perm |= PTE_X;
-
-  // 建立映射，若失败则报错
-  if(mappages(p->pagetable, va, PGSIZE, (uint64)pa, PTE_R | PTE_W | PTE_U) < 0) {
-    panic("lazy_allocation: failed to mappages");
+  struct inode *ip = vma->fp->ip;
+  ilock(ip);
+  if(vmamap(p, vma, va, 1) < 0) {
+    iunlock(ip);
+    return 0;
+  }
+  if(start < vma->start_addr)
+    start = vma->start_addr;
+  if(end > vma->start_addr + vma->length)
+    end = vma->start_addr + vma->length;
+  for(uint64 a = start; a < end; a += PGSIZE) {
+    if(a != va)
+      vmamap(p, vma, a, vma->advice == MADV_SEQUENTIAL);
   }
+  iunlock(ip);
 
   return 1;
 }
@@ -182,7 +182,10 @@ uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
       panic("uvmunmap: not a leaf");
     if(do_free){
       uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+      if(*pte & PTE_PC)
+        pcput(pa);
+      else
+        kfree((void*)pa);
     }
     *pte = 0;
   }
@@ -314,6 +317,13 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
       panic("uvmcopy: page not present");
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if(flags & PTE_PC){
+      // 页缓存中的只读页直接共享
+      if(mappages(new, i, PGSIZE, pa, flags) != 0)
+        goto err;
+      pcdup(pa);
+      continue;
+    }
     if((mem = kalloc()) == 0)
       goto err;
     memmove(mem, (char*)pa, PGSIZE);
@@ -329,6 +339,32 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Give the process a private, writable copy of a read-only
+// page-cache page mapped at va with PTE_COW, as on a write.
+// Returns 0 on success, -1 if va does not map such a page or
+// memory is exhausted.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walk(pagetable, va, 0);
+  if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_PC|PTE_COW)) != (PTE_V|PTE_U|PTE_PC|PTE_COW))
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  pa = PTE2PA(*pte);
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | (PTE_FLAGS(*pte) & ~(PTE_PC|PTE_COW)) | PTE_W;
+  pcput(pa);
+  sfence_vma();
+  return 0;
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -349,9 +385,16 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
+    if(va0 >= MAXVA)
+      return -1;
+    // 只读共享的页缓存页需先复制
+    pte = walk(pagetable, va0, 0);
+    if(pte && (*pte & PTE_PC) && (*pte & PTE_W) == 0 && uvmcow(pagetable, va0) < 0)
+      return -1;
     pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
@@ -435,35 +478,75 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   }
 }
 
-// 删除从va开始的n个字节的映射
+// 一个事务中写回的页数：每页PGSIZE/BSIZE个数据块，
+// 另留inode、间接块与位图各一块。这些块在提交前都钉在块缓存中，
+// 因此NBUF在LOGSIZE之外另留了余量，供提交时读日志块和
+// 其他CPU上的读操作使用(见param.h)
+#define WBPAGES ((LOGSIZE - 1 - 3) / (PGSIZE / BSIZE))
+#define WBBLOCKS (3 + WBPAGES * (PGSIZE / BSIZE))
+
+// 把共享映射vma中[va, va+n)内被写过（PTE_D）的页写回文件，
+// 没被写过的页直接跳过；每个事务写回日志能容纳的最多页数。
+// 写回后清除PTE_D，之后再写才会重新写回。
+void
+vmawriteback(pagetable_t pagetable, uint64 va, uint64 n, struct VMA *vma)
+{
+  struct inode *ip = vma->fp->ip;
+  uint64 a, aoff, len;
+  pte_t *pte;
+  int npages = 0;
+
+  if(!(vma->flags & MAP_SHARED))
+    return;
+
+  for(a = va; a < va + n; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0)
+      continue;
+    if((*pte & (PTE_V|PTE_D)) != (PTE_V|PTE_D))
+      continue;
+    if(npages == 0){
+      begin_opn(WBBLOCKS);
+      ilock(ip);
+    }
+    aoff = a - vma->start_addr; // 计算偏移
+    len = PGSIZE;
+    if(aoff + PGSIZE > vma->length)  // 最后一页未被写满
+      len = vma->length - aoff;
+    writei(ip, 0, PTE2PA(*pte), vma->offset + aoff, len);
+    *pte &= ~PTE_D;
+    if(++npages == WBPAGES){
+      iunlock(ip);
+      end_opn(WBBLOCKS);
+      npages = 0;
+    }
+  }
+  if(npages){
+    iunlock(ip);
+    end_opn(WBBLOCKS);
+  }
+  sfence_vma();
+}
+
+// 删除从va开始的n个字节的映射，先写回共享映射的脏页
 void
 vmaunmap(pagetable_t pagetable, uint64 va, uint64 n, struct VMA *vma)
 {
   uint64 a;
   pte_t *pte;
 
+  vmawriteback(pagetable, va, n, vma);
+
   for(a = va; a < va + n; a += PGSIZE){
     if((pte = walk(pagetable, a, 0)) == 0)
-      panic("vmaunmap: fail to walk");
+      continue;  // 该范围从未被访问过，连页表页都没有
     if(PTE_FLAGS(*pte) == PTE_V)
       panic("vmaunmap: not a leaf");
     if(*pte & PTE_V){
       uint64 pa = PTE2PA(*pte);
-      if((*pte & PTE_D) && (vma->flags & MAP_SHARED)) { // dirty表明需要被写回磁盘
-        begin_op();
-        ilock(vma->fp->ip);
-        uint64 aoff = a - vma->start_addr; // 计算偏移
-        if(aoff < 0) { // 第一页未被写满
-          writei(vma->fp->ip, 0, pa + (-aoff), vma->offset, PGSIZE + aoff);
-        } else if(aoff + PGSIZE > vma->length){  // 最后一页未被写满
-          writei(vma->fp->ip, 0, pa, vma->offset + aoff, vma->length - aoff);
-        } else { // 被写满一页
-          writei(vma->fp->ip, 0, pa, vma->offset + aoff, PGSIZE);
-        }
-        iunlock(vma->fp->ip);
-        end_op();
-      }
-      kfree((void*)pa);
+      if(*pte & PTE_PC)
+        pcput(pa);
+      else
+        kfree((void*)pa);
       *pte = 0;
     }
   }
@@ -0,0 +1,365 @@
+// Virtual memory areas for mmap.
+//
+// Each process keeps its VMAs in an AVL tree ordered by start
+// address.  The areas never overlap, so a page fault finds the
+// VMA containing an address in O(log n), and the number of
+// mappings is limited only by memory: VMA structs are carved out
+// of pages from kalloc and recycled through a free list.
+//
+// Adjacent mappings of the same open file with the same
+// protection, flags and contiguous file offsets are merged into
+// one VMA; munmap may remove any page-aligned range, splitting a
+// VMA in two when the range lies in its middle.
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+struct {
+  struct spinlock lock;
+  struct VMA *freelist;  // 经由 left 链接
+} vmapool;
+
+void
+vmainit(void)
+{
+  initlock(&vmapool.lock, "vma");
+}
+
+// Allocate a zeroed VMA.  Returns 0 if out of memory.
+struct VMA*
+vmaalloc(void)
+{
+  struct VMA *v;
+  char *pg;
+
+  acquire(&vmapool.lock);
+  if(vmapool.freelist == 0){
+    // 取一页切分成若干个VMA
+    if((pg = kalloc()) == 0){
+      release(&vmapool.lock);
+      return 0;
+    }
+    for(v = (struct VMA*)pg; v + 1 <= (struct VMA*)(pg + PGSIZE); v++){
+      v->left = vmapool.freelist;
+      vmapool.freelist = v;
+    }
+  }
+  v = vmapool.freelist;
+  vmapool.freelist = v->left;
+  release(&vmapool.lock);
+
+  memset(v, 0, sizeof(*v));
+  v->height = 1;
+  return v;
+}
+
+void
+vmafree(struct VMA *v)
+{
+  acquire(&vmapool.lock);
+  v->left = vmapool.freelist;
+  vmapool.freelist = v;
+  release(&vmapool.lock);
+}
+
+static int
+height(struct VMA *v)
+{
+  return v ? v->height : 0;
+}
+
+static void
+fixheight(struct VMA *v)
+{
+  int hl = height(v->left), hr = height(v->right);
+
+  v->height = (hl > hr ? hl : hr) + 1;
+}
+
+static struct VMA*
+rotateright(struct VMA *v)
+{
+  struct VMA *l = v->left;
+
+  v->left = l->right;
+  l->right = v;
+  fixheight(v);
+  fixheight(l);
+  return l;
+}
+
+static struct VMA*
+rotateleft(struct VMA *v)
+{
+  struct VMA *r = v->right;
+
+  v->right = r->left;
+  r->left = v;
+  fixheight(v);
+  fixheight(r);
+  return r;
+}
+
+// 恢复以v为根的子树的平衡，返回新的根
+static struct VMA*
+balance(struct VMA *v)
+{
+  fixheight(v);
+  if(height(v->left) - height(v->right) > 1){
+    if(height(v->left->left) < height(v->left->right))
+      v->left = rotateleft(v->left);
+    return rotateright(v);
+  }
+  if(height(v->right) - height(v->left) > 1){
+    if(height(v->right->right) < height(v->right->left))
+      v->right = rotateright(v->right);
+    return rotateleft(v);
+  }
+  return v;
+}
+
+static struct VMA*
+vmaput(struct VMA *root, struct VMA *v)
+{
+  if(root == 0)
+    return v;
+  if(v->start_addr < root->start_addr)
+    root->left = vmaput(root->left, v);
+  else
+    root->right = vmaput(root->right, v);
+  return balance(root);
+}
+
+static struct VMA*
+vmadelmin(struct VMA *root, struct VMA **min)
+{
+  if(root->left == 0){
+    *min = root;
+    return root->right;
+  }
+  root->left = vmadelmin(root->left, min);
+  return balance(root);
+}
+
+static struct VMA*
+vmadel(struct VMA *root, struct VMA *v)
+{
+  struct VMA *m, *r;
+
+  if(root == 0)
+    panic("vmadel");
+  if(v->start_addr < root->start_addr){
+    root->left = vmadel(root->left, v);
+  } else if(v->start_addr > root->start_addr){
+    root->right = vmadel(root->right, v);
+  } else {
+    if(root->right == 0)
+      return root->left;
+    r = vmadelmin(root->right, &m);
+    m->left = root->left;
+    m->right = r;
+    return balance(m);
+  }
+  return balance(root);
+}
+
+// 判断该缺页异常是否是由vma懒分配导致的
+struct VMA*
+vma_check(struct proc *p, uint64 va)
+{
+  struct VMA *v = p->vmas;
+
+  while(v){
+    if(va < v->start_addr)
+      v = v->left;
+    else if(va >= v->start_addr + v->length)
+      v = v->right;
+    else
+      return v;
+  }
+  return 0;
+}
+
+// 起始地址不小于va的第一个VMA
+static struct VMA*
+vmaceil(struct proc *p, uint64 va)
+{
+  struct VMA *v = p->vmas, *best = 0;
+
+  while(v){
+    if(v->start_addr >= va){
+      best = v;
+      v = v->left;
+    } else {
+      v = v->right;
+    }
+  }
+  return best;
+}
+
+// 地址最低的VMA，mmap在它之下分配新的映射
+struct VMA*
+vmalowest(struct proc *p)
+{
+  return vmaceil(p, 0);
+}
+
+// a紧挨在b之前，且映射同一文件的连续部分
+static int
+vmaadjacent(struct VMA *a, struct VMA *b)
+{
+  return a->start_addr + a->length == b->start_addr
+    && a->fp == b->fp && a->prot == b->prot && a->flags == b->flags
+    && a->advice == b->advice
+    && a->offset + a->length == b->offset;
+}
+
+// Add v to p's VMAs, merging it into an adjacent compatible
+// mapping when possible, in which case v is freed.
+void
+vmainsert(struct proc *p, struct VMA *v)
+{
+  struct VMA *prev, *next;
+
+  prev = v->start_addr ? vma_check(p, v->start_addr - 1) : 0;
+  next = vma_check(p, v->start_addr + v->length);
+
+  if(prev && vmaadjacent(prev, v)){
+    prev->length += v->length;
+    fileclose(v->fp);
+    vmafree(v);
+    if(next && vmaadjacent(prev, next)){
+      prev->length += next->length;
+      p->vmas = vmadel(p->vmas, next);
+      fileclose(next->fp);
+      vmafree(next);
+    }
+    return;
+  }
+  if(next && vmaadjacent(v, next)){
+    // 只改变next的起始地址，树中的顺序不变
+    next->start_addr = v->start_addr;
+    next->offset = v->offset;
+    next->length += v->length;
+    fileclose(v->fp);
+    vmafree(v);
+    return;
+  }
+  p->vmas = vmaput(p->vmas, v);
+}
+
+// Split v at the page-aligned address addr inside it: v keeps
+// [start, addr) and a new VMA for [addr, end) is added to p's
+// VMAs and returned.  Returns 0 if out of memory.
+struct VMA*
+vmasplit(struct proc *p, struct VMA *v, uint64 addr)
+{
+  struct VMA *t;
+
+  if((t = vmaalloc()) == 0)
+    return 0;
+  *t = *v;
+  t->left = t->right = 0;
+  t->height = 1;
+  t->start_addr = addr;
+  t->length = v->start_addr + v->length - addr;
+  t->offset = v->offset + (addr - v->start_addr);
+  filedup(t->fp);
+  v->length = addr - v->start_addr;
+  p->vmas = vmaput(p->vmas, t);
+  return t;
+}
+
+// Remove the mappings of [addr, addr+len), which must be
+// page-aligned, writing dirty MAP_SHARED pages back.  The range
+// may cover several VMAs and holes.  Returns 0 on success, -1
+// if out of memory while splitting a VMA.
+int
+vmaremove(struct proc *p, uint64 addr, uint64 len)
+{
+  struct VMA *v;
+  uint64 a, e, end, vend;
+
+  end = addr + len;
+  for(a = addr; a < end; a = e){
+    if((v = vma_check(p, a)) == 0){
+      if((v = vmaceil(p, a)) == 0 || v->start_addr >= end)
+        break;
+      a = v->start_addr;
+    }
+    vend = v->start_addr + v->length;
+    e = end < vend ? end : vend;
+
+    if(a > v->start_addr && e < vend){
+      // 从中间挖去一段，后半部分成为新的VMA
+      if(vmasplit(p, v, e) == 0)
+        return -1;
+      vend = e;
+    }
+
+    // 删除映射并写回数据
+    vmaunmap(p->pagetable, a, e - a, v);
+
+    if(a == v->start_addr && e == vend){
+      p->vmas = vmadel(p->vmas, v);
+      fileclose(v->fp);
+      vmafree(v);
+    } else if(a == v->start_addr){
+      v->offset += e - a;
+      v->start_addr = e;
+      v->length -= e - a;
+    } else {
+      v->length = a - v->start_addr;
+    }
+  }
+  return 0;
+}
+
+static int
+vmacopy(struct proc *np, struct VMA *v)
+{
+  struct VMA *nv;
+
+  if(v == 0)
+    return 0;
+  if((nv = vmaalloc()) == 0)
+    return -1;
+  *nv = *v;
+  nv->left = nv->right = 0;
+  nv->height = 1;
+  filedup(nv->fp);
+  np->vmas = vmaput(np->vmas, nv);
+  if(vmacopy(np, v->left) < 0 || vmacopy(np, v->right) < 0)
+    return -1;
+  return 0;
+}
+
+// 子进程拷贝父进程所有的vma，并将对应文件的被引用次数加一，
+// 但不拷贝实际的物理页和页表项
+int
+vmadup(struct proc *np, struct proc *p)
+{
+  if(vmacopy(np, p->vmas) < 0){
+    vmaclear(np);
+    return -1;
+  }
+  return 0;
+}
+
+// 解除进程的所有映射，写回共享映射的脏页
+void
+vmaclear(struct proc *p)
+{
+  struct VMA *v;
+
+  while((v = p->vmas) != 0){
+    vmaunmap(p->pagetable, v->start_addr, v->length, v);
+    p->vmas = vmadel(p->vmas, v);
+    fileclose(v->fp);
+    vmafree(v);
+  }
+}
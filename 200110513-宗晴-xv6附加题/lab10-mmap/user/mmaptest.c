@@ -8,6 +8,9 @@
 
 void mmap_test();
 void fork_test();
+void vma_test();
+void populate_test();
+void msync_test();
 char buf[BSIZE];
 
 #define MAP_FAILED ((char *) -1)
@@ -17,6 +20,9 @@ main(int argc, char *argv[])
 {
   mmap_test();
   fork_test();
+  vma_test();
+  populate_test();
+  msync_test();
   printf("mmaptest: all tests succeeded\n");
   exit(0);
 }
@@ -295,3 +301,318 @@ fork_test(void)
   printf("fork_test OK\n");
 }
 
+//
+// check that touching addr kills the process.
+//
+void
+_unmapped(char *addr)
+{
+  int pid, status = 0;
+
+  if((pid = fork()) < 0)
+    err("fork");
+  if(pid == 0){
+    (void)*(volatile char *)addr;
+    exit(0);  // should have been killed
+  }
+  wait(&status);
+  if(status == 0)
+    err("access to unmapped page succeeded");
+}
+
+//
+// many mappings, merging of adjacent mappings, munmap
+// that splits a mapping or spans several of them.
+//
+void
+vma_test(void)
+{
+  int fd, i;
+  const char * const f = "mmap.dur";
+  char *p, *q, *ps[20];
+
+  printf("vma_test starting\n");
+  testname = "vma_test";
+
+  makefile(f);
+  if ((fd = open(f, O_RDONLY)) == -1)
+    err("open");
+
+  // more mappings than the old 16-entry array could hold.
+  // each maps offset 0, so none of them can be merged.
+  for (i = 0; i < 20; i++) {
+    ps[i] = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ps[i] == MAP_FAILED)
+      err("mmap many");
+  }
+  for (i = 0; i < 20; i++) {
+    if (ps[i][0] != 'A' || ps[i][PGSIZE-1] != 'A')
+      err("many mismatch");
+  }
+  for (i = 0; i < 20; i++) {
+    if (munmap(ps[i], PGSIZE) == -1)
+      err("munmap many");
+  }
+
+  // the second mapping lands right below the first and maps
+  // the file page before it, so the two become one mapping.
+  p = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE, fd, PGSIZE);
+  if (p == MAP_FAILED)
+    err("mmap merge (1)");
+  q = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (q == MAP_FAILED)
+    err("mmap merge (2)");
+  if (q + PGSIZE != p)
+    err("merge not adjacent");
+  _v1(q);
+  if (munmap(q, PGSIZE*2) == -1)
+    err("munmap merged");
+  if (munmap(q, PGSIZE) != -1)
+    err("munmap merged twice");
+
+  // punch a hole in the middle of a mapping.
+  p = mmap(0, PGSIZE*3, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap split");
+  if (munmap(p + PGSIZE, PGSIZE) == -1)
+    err("munmap middle");
+  if (p[0] != 'A' || p[PGSIZE*2] != 0)
+    err("split mismatch");
+  _unmapped(p + PGSIZE);
+  if (munmap(p + PGSIZE, PGSIZE) != -1)
+    err("munmap hole");
+  if (munmap(p, PGSIZE) == -1 || munmap(p + PGSIZE*2, PGSIZE) == -1)
+    err("munmap split halves");
+
+  // one munmap over two mappings that cannot be merged.
+  p = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  q = mmap(0, PGSIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED || q == MAP_FAILED)
+    err("mmap span");
+  if (q + PGSIZE != p)
+    err("span not adjacent");
+  if (p[0] != 'A' || q[0] != 'A')
+    err("span mismatch");
+  if (munmap(q, PGSIZE*2) == -1)
+    err("munmap span");
+  if (munmap(p, PGSIZE) != -1 || munmap(q, PGSIZE) != -1)
+    err("span still mapped");
+  _unmapped(p);
+
+  close(fd);
+  printf("vma_test OK\n");
+}
+
+//
+// create f with npages pages of 'A'.
+//
+void
+makepages(const char *f, int npages)
+{
+  int i, fd;
+
+  unlink(f);
+  if ((fd = open(f, O_WRONLY | O_CREATE)) == -1)
+    err("open");
+  memset(buf, 'A', BSIZE);
+  for (i = 0; i < npages * (PGSIZE/BSIZE); i++) {
+    if (write(fd, buf, BSIZE) != BSIZE)
+      err("write makepages");
+  }
+  if (close(fd) == -1)
+    err("close");
+}
+
+//
+// empty file f.  pages a process has already mapped stay
+// mapped with their old content, so afterwards a page that
+// still reads 'A' was mapped before the truncation.  pages
+// that were not mapped are not checked.
+//
+void
+truncfile(const char *f)
+{
+  int fd;
+
+  if ((fd = open(f, O_WRONLY | O_TRUNC)) == -1)
+    err("open truncate");
+  close(fd);
+}
+
+//
+// check that the pages [first, first+n) of a mapping at p
+// were mapped before f was truncated.
+//
+void
+checkmapped(char *p, int first, int n, char *what)
+{
+  int i;
+
+  for (i = first; i < first + n; i++) {
+    if (p[i*PGSIZE] != 'A' || p[i*PGSIZE + PGSIZE-1] != 'A') {
+      printf("%s: page %d not mapped\n", what, i);
+      err(what);
+    }
+  }
+}
+
+//
+// a fault maps the cached pages of its FAULTAROUND window,
+// MADV_SEQUENTIAL reads the next FAULTAROUND pages ahead,
+// and MAP_POPULATE and MADV_WILLNEED map every page up front.
+//
+void
+populate_test(void)
+{
+  int fd, i, first, n;
+  char *p;
+  uint64 w, off;
+  const char * const f = "mmap.dur";
+
+  printf("populate_test starting\n");
+  testname = "populate_test";
+
+  // fault-around: read the file so that every page is cached,
+  // then touch one page of the mapping.
+  makepages(f, FAULTAROUND);
+  if ((fd = open(f, O_RDONLY)) == -1)
+    err("open");
+  for (i = 0; i < FAULTAROUND * (PGSIZE/BSIZE); i++) {
+    if (read(fd, buf, BSIZE) != BSIZE)
+      err("read");
+  }
+  p = mmap(0, PGSIZE*FAULTAROUND, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap faultaround");
+  close(fd);
+  // the mapping covers at most two aligned windows; touch the
+  // first page of the larger part.
+  w = (uint64)PGSIZE*FAULTAROUND;
+  off = (uint64)p % w;
+  if (off <= w/2) {
+    first = 0;
+    n = (w - off) / PGSIZE;
+  } else {
+    first = (w - off) / PGSIZE;
+    n = FAULTAROUND - first;
+  }
+  (void)*(volatile char *)(p + first*PGSIZE);
+  truncfile(f);
+  checkmapped(p, first, n, "fault-around");
+  if (munmap(p, PGSIZE*FAULTAROUND) == -1)
+    err("munmap faultaround");
+
+  // read-ahead: none of the pages are cached before the fault.
+  makepages(f, FAULTAROUND);
+  if ((fd = open(f, O_RDONLY)) == -1)
+    err("open");
+  p = mmap(0, PGSIZE*FAULTAROUND, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap sequential");
+  close(fd);
+  if (madvise(p, PGSIZE*FAULTAROUND, MADV_SEQUENTIAL) == -1)
+    err("madvise sequential");
+  if (madvise(p, PGSIZE*FAULTAROUND, 99) != -1)
+    err("madvise bad advice");
+  (void)*(volatile char *)p;
+  truncfile(f);
+  checkmapped(p, 0, FAULTAROUND, "read-ahead");
+  if (munmap(p, PGSIZE*FAULTAROUND) == -1)
+    err("munmap sequential");
+
+  makepages(f, 4);
+  if ((fd = open(f, O_RDONLY)) == -1)
+    err("open");
+  p = mmap(0, PGSIZE*4, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap populate");
+  close(fd);
+  truncfile(f);
+  checkmapped(p, 0, 4, "MAP_POPULATE");
+  if (munmap(p, PGSIZE*4) == -1)
+    err("munmap populate");
+
+  makepages(f, 4);
+  if ((fd = open(f, O_RDONLY)) == -1)
+    err("open");
+  p = mmap(0, PGSIZE*4, PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap willneed");
+  close(fd);
+  if (madvise(p, PGSIZE*4, MADV_WILLNEED) == -1)
+    err("madvise willneed");
+  truncfile(f);
+  checkmapped(p, 0, 4, "MADV_WILLNEED");
+  if (munmap(p, PGSIZE*4) == -1)
+    err("munmap willneed");
+
+  printf("populate_test OK\n");
+}
+
+//
+// msync writes dirty pages of a MAP_SHARED mapping back to the
+// file and skips clean ones.  a store only changes the cached
+// page, so the file grows when msync writes the dirty partial
+// last page back, and would grow further if it also wrote the
+// clean page after it.
+//
+void
+msync_test(void)
+{
+  int fd;
+  char *p, c;
+  struct stat st;
+  const char * const f = "mmap.dur";
+
+  printf("msync_test starting\n");
+  testname = "msync_test";
+
+  makefile(f);
+  if ((fd = open(f, O_RDWR)) == -1)
+    err("open");
+  p = mmap(0, PGSIZE*3, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap shared");
+  if (p[PGSIZE*2] != 0)
+    err("read third page");
+  p[PGSIZE*2 - 1] = 'Z';
+  if (fstat(fd, &st) == -1)
+    err("fstat");
+  if (st.size != PGSIZE + PGSIZE/2)
+    err("store changed the file size");
+  if (msync(p, PGSIZE*3, MS_SYNC) == -1)
+    err("msync");
+  if (fstat(fd, &st) == -1)
+    err("fstat");
+  if (st.size == PGSIZE + PGSIZE/2)
+    err("msync did not write back the dirty page");
+  if (st.size != PGSIZE*2)
+    err("msync wrote back a clean page");
+
+  if (msync(p, PGSIZE, MS_ASYNC | MS_SYNC) != -1)
+    err("msync accepted MS_ASYNC|MS_SYNC");
+  if (msync(p + 1, PGSIZE, MS_SYNC) != -1)
+    err("msync accepted an unaligned address");
+  if (munmap(p, PGSIZE*3) == -1)
+    err("munmap shared");
+  if (msync(p, PGSIZE, MS_SYNC) != -1)
+    err("msync accepted an unmapped address");
+  close(fd);
+
+  // a private mapping has nothing to write back.
+  if ((fd = open(f, O_RDWR)) == -1)
+    err("open");
+  p = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED)
+    err("mmap private");
+  p[0] = 'Y';
+  if (msync(p, PGSIZE, MS_SYNC) == -1)
+    err("msync private");
+  if (read(fd, &c, 1) != 1 || c != 'A')
+    err("msync wrote back a private page");
+  if (munmap(p, PGSIZE) == -1)
+    err("munmap private");
+  close(fd);
+
+  printf("msync_test OK\n");
+}
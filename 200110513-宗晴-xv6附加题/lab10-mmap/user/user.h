@@ -25,6 +25,8 @@ int sleep(int);
 int uptime(void);
 char* mmap(void *, uint64, int, int, int, uint64);
 int munmap(void *, uint64);
+int madvise(void *, uint64, int);
+int msync(void *, uint64, int);
 
 
 // ulib.c
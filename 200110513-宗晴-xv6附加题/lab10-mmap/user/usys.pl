@@ -38,3 +38,5 @@ entry("sleep");
 entry("uptime");
 entry("mmap");
 entry("munmap");
+entry("madvise");
+entry("msync");
@@ -173,6 +173,8 @@ int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 int             lazy_check(uint64);
 void            lazy_allocation(uint64 va);
+void            lazy_prefault(uint64, uint64);
+void            lazy_truncate(uint64);
 
 // plic.c
 void            plicinit(void);
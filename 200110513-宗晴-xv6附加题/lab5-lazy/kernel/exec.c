@@ -7,8 +7,6 @@
 #include "defs.h"
 #include "elf.h"
 
-static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
-
 int
 exec(char *path, char **argv)
 {
@@ -16,8 +14,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG+1], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exeip = 0, *oldexeip;
   struct proghdr ph;
+  struct execseg segs[NEXECSEG];
+  int nseg = 0;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
@@ -38,7 +38,9 @@ exec(char *path, char **argv)
   if((pagetable = proc_pagetable(p)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // Record the program segments; their pages are read in from
+  // ip by lazy_allocation() on first access, and the rest of
+  // each segment is zero-filled like any lazily allocated page.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, 0, (uint64)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
@@ -48,17 +50,24 @@ exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    // 段和其后的两页栈不能伸到trapframe和trampoline
+    if(ph.vaddr + ph.memsz > TRAPFRAME - 2*PGSIZE)
       goto bad;
-    sz = sz1;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
-    if(loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(nseg >= NEXECSEG)
       goto bad;
+    segs[nseg].va = ph.vaddr;
+    segs[nseg].fend = ph.vaddr + ph.filesz;
+    segs[nseg].off = ph.off;
+    nseg++;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
   }
-  iunlockput(ip);
+  // 保留对可执行文件的引用，供之后缺页时读入
+  iunlock(ip);
   end_op();
+  exeip = ip;
   ip = 0;
 
   p = myproc();
@@ -116,6 +125,16 @@ exec(char *path, char **argv)
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
 
+  oldexeip = p->exeip;
+  p->exeip = exeip;
+  memmove(p->segs, segs, sizeof(segs));
+  p->nseg = nseg;
+  if(oldexeip){
+    begin_op();
+    iput(oldexeip);
+    end_op();
+  }
+
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
@@ -125,33 +144,10 @@ exec(char *path, char **argv)
     iunlockput(ip);
     end_op();
   }
-  return -1;
-}
-
-// Load a program segment into pagetable at virtual address va.
-// va must be page-aligned
-// and the pages from va to va+sz must already be mapped.
-// Returns 0 on success, -1 on failure.
-static int
-loadseg(pagetable_t pagetable, uint64 va, struct inode *ip, uint offset, uint sz)
-{
-  uint i, n;
-  uint64 pa;
-
-  if((va % PGSIZE) != 0)
-    panic("loadseg: va must be page aligned");
-
-  for(i = 0; i < sz; i += PGSIZE){
-    pa = walkaddr(pagetable, va + i);
-    if(pa == 0)
-      panic("loadseg: address should exist");
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, 0, (uint64)pa, offset+i, n) != n)
-      return -1;
+  if(exeip){
+    begin_op();
+    iput(exeip);
+    end_op();
   }
-  
-  return 0;
+  return -1;
 }
@@ -111,6 +111,9 @@ fileread(struct file *f, uint64 addr, int n)
   if(f->readable == 0)
     return -1;
 
+  // 下面的拷贝可能在持有锁时进行，先分配好缓冲区所在的页
+  lazy_prefault(addr, n);
+
   if(f->type == FD_PIPE){
     r = piperead(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
@@ -139,6 +142,9 @@ filewrite(struct file *f, uint64 addr, int n)
   if(f->writable == 0)
     return -1;
 
+  // 下面的拷贝可能在持有锁时进行，先读入缓冲区所在的页
+  lazy_prefault(addr, n);
+
   if(f->type == FD_PIPE){
     ret = pipewrite(f->pipe, addr, n);
   } else if(f->type == FD_DEVICE){
@@ -289,6 +289,12 @@ fork(void)
       np->ofile[i] = filedup(p->ofile[i]);
   np->cwd = idup(p->cwd);
 
+  // 子进程同样按需从可执行文件读入尚未分配的程序段页
+  if(p->exeip)
+    np->exeip = idup(p->exeip);
+  memmove(np->segs, p->segs, sizeof(p->segs));
+  np->nseg = p->nseg;
+
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
@@ -348,8 +354,12 @@ exit(int status)
 
   begin_op();
   iput(p->cwd);
+  if(p->exeip)
+    iput(p->exeip);
   end_op();
   p->cwd = 0;
+  p->exeip = 0;
+  p->nseg = 0;
 
   // we might re-parent a child to init. we can't be precise about
   // waking up init, since we can't acquire its lock once we've
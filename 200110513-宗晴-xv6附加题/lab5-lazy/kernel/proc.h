@@ -82,6 +82,13 @@ struct trapframe {
 
 enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A program segment that exec() left to be read in on demand.
+struct execseg {
+  uint64 va;                   // 段的起始虚拟地址，按页对齐
+  uint64 fend;                 // 文件内容在内存中的结束地址，之后的部分为零
+  uint off;                    // 段在可执行文件中的偏移
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -103,4 +110,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct inode *exeip;         // 可执行文件，缺页时从中读入程序段
+  struct execseg segs[NEXECSEG];
+  int nseg;
 };
@@ -35,6 +35,9 @@ sys_wait(void)
   uint64 p;
   if(argaddr(0, &p) < 0)
     return -1;
+  // wait()持有进程锁时拷贝退出状态
+  if(p != 0)
+    lazy_prefault(p, sizeof(int));
   return wait(p);
 }
 
@@ -49,8 +52,10 @@ sys_sbrk(void)
 
   struct proc *p = myproc();
   addr = p->sz;
-  if(n < 0)
+  if(n < 0){
     uvmdealloc(p->pagetable, p->sz, p->sz+n); // 如果是缩小空间，则立即释放
+    lazy_truncate(p->sz+n);
+  }
   p->sz += n; // 懒分配，只修改sz的值而不分配物理内存
   return addr;
 }
@@ -69,7 +69,7 @@ usertrap(void)
     // ok
   } else {
     uint64 va = r_stval();
-    if((r_scause() == 13 || r_scause() == 15) && lazy_check(va))  // 缺页异常并且是懒分配导致的
+    if((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) && lazy_check(va))  // 缺页异常并且是懒分配导致的
       lazy_allocation(va);  // 分配物理内存并建立映射
     else {  // 其它情况则报错
       printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
@@ -7,6 +7,8 @@
 #include "fs.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sleeplock.h"
+#include "file.h"
 
 /*
  * the kernel's page table.
@@ -356,15 +358,16 @@ uvmclear(pagetable_t pagetable, uint64 va)
 int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
-  // 若由于懒分配还未分配实际的页，则需要进行分配
-  if(lazy_check(dstva))
-    lazy_allocation(dstva);
-
   uint64 n, va0, pa0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
     pa0 = walkaddr(pagetable, va0);
+    // 若由于懒分配还未分配实际的页，则需要进行分配
+    if(pa0 == 0 && pagetable == myproc()->pagetable && lazy_check(va0)){
+      lazy_allocation(va0);
+      pa0 = walkaddr(pagetable, va0);
+    }
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (dstva - va0);
@@ -385,15 +388,16 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  // 若由于懒分配还未分配实际的页，则需要进行分配
-  if(lazy_check(srcva))
-    lazy_allocation(srcva);
-
   uint64 n, va0, pa0;
 
   while(len > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    // 若由于懒分配还未分配实际的页，则需要进行分配
+    if(pa0 == 0 && pagetable == myproc()->pagetable && lazy_check(va0)){
+      lazy_allocation(va0);
+      pa0 = walkaddr(pagetable, va0);
+    }
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -421,6 +425,11 @@ copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
   while(got_null == 0 && max > 0){
     va0 = PGROUNDDOWN(srcva);
     pa0 = walkaddr(pagetable, va0);
+    // 路径等字符串常量可能位于尚未读入的程序段中
+    if(pa0 == 0 && pagetable == myproc()->pagetable && lazy_check(va0)){
+      lazy_allocation(va0);
+      pa0 = walkaddr(pagetable, va0);
+    }
     if(pa0 == 0)
       return -1;
     n = PGSIZE - (srcva - va0);
@@ -463,6 +472,32 @@ lazy_check(uint64 va)
       && (((pte = walk(p->pagetable, va, 0))==0) || ((*pte & PTE_V)==0));  // 页表项不存在或无效
 }
 
+// 若va所在的页属于exec()记录的程序段，则从可执行文件读入该页的内容
+static int
+lazy_load(struct proc *p, uint64 va, char *mem)
+{
+  struct execseg *s;
+  uint64 start, end;
+  int locked, r;
+
+  for(s = p->segs; s < &p->segs[p->nseg]; s++){
+    start = va > s->va ? va : s->va;
+    end = va + PGSIZE < s->fend ? va + PGSIZE : s->fend;
+    if(start >= end)
+      continue;
+    // read()读入进程自身的可执行文件时已持有该inode的锁
+    locked = holdingsleep(&p->exeip->lock);
+    if(!locked)
+      ilock(p->exeip);
+    r = readi(p->exeip, 0, (uint64)mem + (start - va), s->off + (start - s->va), end - start);
+    if(!locked)
+      iunlock(p->exeip);
+    if(r != end - start)
+      return -1;
+  }
+  return 0;
+}
+
 void
 lazy_allocation(uint64 va)
 { 
@@ -475,8 +510,14 @@ lazy_allocation(uint64 va)
     p->killed = 1;
   } else {
     memset(mem, 0, PGSIZE);
+    // 读入程序段
+    if(lazy_load(p, PGROUNDDOWN(va), mem) < 0){
+      printf("lazy page allocation: failed to read %s\n", p->name);
+      kfree(mem);
+      p->killed = 1;
+    }
     // 建立映射
-    if(mappages(p->pagetable, PGROUNDDOWN(va), PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) < 0){
+    else if(mappages(p->pagetable, PGROUNDDOWN(va), PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) < 0){
       // 映射失败
       printf("lazy page allocation: failed to mappages\n");
       kfree(mem);
@@ -484,3 +525,42 @@ lazy_allocation(uint64 va)
     }
   } 
 } 
+
+// 预先读入[va, va+n)中属于程序段且尚未分配的页。
+// 读入程序段会睡眠，因此持有自旋锁或其他inode锁进行拷贝的
+// 代码(管道、控制台、readi()/writei()等)须在加锁前调用
+void
+lazy_prefault(uint64 va, uint64 n)
+{
+  struct proc *p = myproc();
+  struct execseg *s;
+  uint64 a, start, end;
+
+  if(va + n < va)
+    return;  // 非法的范围，之后的拷贝会失败
+  // 只需预先读入程序段的页；零填充的页在拷贝时分配不会睡眠，
+  // 仍按需分配
+  for(s = p->segs; s < &p->segs[p->nseg]; s++){
+    start = va > s->va ? va : s->va;
+    end = va + n < s->fend ? va + n : s->fend;
+    if(end > p->sz)
+      end = p->sz;
+    for(a = PGROUNDDOWN(start); a < end && !p->killed; a += PGSIZE){
+      if(lazy_check(a))
+        lazy_allocation(a);
+    }
+  }
+}
+
+// 进程内存缩小到sz：之后再增长时新内存应为零，而不是重新读入程序段
+void
+lazy_truncate(uint64 sz)
+{
+  struct proc *p = myproc();
+  struct execseg *s;
+
+  for(s = p->segs; s < &p->segs[p->nseg]; s++){
+    if(s->fend > sz)
+      s->fend = sz > s->va ? sz : s->va;
+  }
+}
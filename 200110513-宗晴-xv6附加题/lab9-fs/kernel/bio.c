@@ -26,6 +26,7 @@
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
+  int ndelay;  // 被延迟分配数据块占用的缓冲块数量
 
   // Linked list of all buffers, through prev/next.
   // Sorted by how recently the buffer was used.
@@ -64,7 +65,7 @@ bget(uint dev, uint blockno)
 
   // Is the block already cached?
   for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
+    if(!b->delay && b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
@@ -78,6 +79,8 @@ bget(uint dev, uint blockno)
     if(b->refcnt == 0) {
       b->dev = dev;
       b->blockno = blockno;
+      b->delay = 0;
+      b->owner = 0;
       b->valid = 0;
       b->refcnt = 1;
       release(&bcache.lock);
@@ -150,4 +153,75 @@ bunpin(struct buf *b) {
   release(&bcache.lock);
 }
 
+// Delayed allocation.
+//
+// A newly written data block of a file need not get a disk
+// block right away: its contents stay in a buffer owned by
+// the in-memory inode, keyed by the logical block number, and
+// pinned until fs.c gives it a real block (or the file is
+// truncated). Such buffers are never found by bget().
+
+// Return a locked delayed buffer for block bn of ip.
+// If there is none and create is set, make a zeroed one,
+// unless NDELAY buffers are already in use.
+struct buf*
+bgetdelay(struct inode *ip, uint bn, int create)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+    if(b->delay && b->owner == ip && b->blockno == bn){
+      b->refcnt++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      return b;
+    }
+  }
+
+  if(!create || bcache.ndelay >= NDELAY){
+    release(&bcache.lock);
+    return 0;
+  }
+
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    if(b->refcnt == 0) {
+      b->blockno = bn;
+      b->delay = 1;
+      b->owner = ip;
+      b->valid = 1;
+      b->refcnt = 2;  // 调用者一个，延迟期间常驻一个
+      bcache.ndelay++;
+      release(&bcache.lock);
+      acquiresleep(&b->lock);
+      memset(b->data, 0, BSIZE);
+      return b;
+    }
+  }
+  panic("bgetdelay: no buffers");
+}
+
+// Detach a locked delayed buffer from its inode, once its
+// contents have been copied to a real block or discarded.
+// The caller still has to brelse() it.
+void
+bundelay(struct buf *b)
+{
+  if(!holdingsleep(&b->lock) || !b->delay)
+    panic("bundelay");
+  acquire(&bcache.lock);
+  b->owner = 0;
+  b->valid = 0;
+  b->refcnt--;
+  bcache.ndelay--;
+  release(&bcache.lock);
+}
+
+// Are all delayed-allocation buffers in use?
+int
+bdelayfull(void)
+{
+  return bcache.ndelay >= NDELAY;
+}
+
 
@@ -5,6 +5,8 @@ struct buf {
   uint blockno;
   struct sleeplock lock;
   uint refcnt;
+  int delay;   // 延迟分配的数据块，blockno为owner中的逻辑块号
+  struct inode *owner;
   struct buf *prev; // LRU cache list
   struct buf *next;
   uchar data[BSIZE];
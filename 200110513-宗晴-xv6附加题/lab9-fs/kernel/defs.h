@@ -4,6 +4,8 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct rwlock;
+struct seqlock;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -16,6 +18,9 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+struct buf*     bgetdelay(struct inode*, uint, int);
+void            bundelay(struct buf*);
+int             bdelayfull(void);
 
 // console.c
 void            consoleinit(void);
@@ -51,8 +56,11 @@ struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
+int             istat(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+uint            writeimax(uint, uint);
 void            itrunc(struct inode*);
+void            iflushall(void);
 
 // ramdisk.c
 void            ramdiskinit(void);
@@ -69,6 +77,7 @@ void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
+void            logflusher(void);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
@@ -99,6 +108,12 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+void            kthread(void (*)(void), char*);
+int             proctick(void);
+int             setpriority(int, int);
+int             getprocs(uint64, int);
+int             sleepuntil(uint64);
+void            timerexpire(void);
 int             wait(uint64);
 void            wakeup(void*);
 void            yield(void);
@@ -113,7 +128,20 @@ void            swtch(struct context*, struct context*);
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            freelock(struct spinlock*);
 void            release(struct spinlock*);
+int             lockstat(uint64, int);
+void            initrwlock(struct rwlock*, char*);
+void            acquireread(struct rwlock*);
+void            releaseread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            releasewrite(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+void            initseqlock(struct seqlock*, char*);
+void            writeseqlock(struct seqlock*);
+void            writesequnlock(struct seqlock*);
+uint            readseqbegin(struct seqlock*);
+int             readseqretry(struct seqlock*, uint);
 void            push_off(void);
 void            pop_off(void);
 
@@ -146,6 +174,8 @@ void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            timeridle(int);
+void            timerarm(uint64);
 
 // uart.c
 void            uartinit(void);
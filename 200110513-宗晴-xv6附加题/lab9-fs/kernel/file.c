@@ -91,9 +91,12 @@ filestat(struct file *f, uint64 addr)
   struct stat st;
   
   if(f->type == FD_INODE || f->type == FD_DEVICE){
-    ilock(f->ip);
-    stati(f->ip, &st);
-    iunlock(f->ip);
+    // inode已在内存中时无需获取睡眠锁，不必等待正在写文件的进程
+    if(istat(f->ip, &st) < 0){
+      ilock(f->ip);
+      stati(f->ip, &st);
+      iunlock(f->ip);
+    }
     if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
@@ -146,21 +149,21 @@ filewrite(struct file *f, uint64 addr, int n)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
   } else if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    // write as many blocks at a time as fit in one log
+    // transaction; writeimax() accounts for the i-node,
+    // index and bitmap blocks touched by the range.
     int i = 0;
+
+    // 延迟分配的缓冲块已用完，先为它们分配磁盘块
+    if(bdelayfull())
+      iflushall();
+
     while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+      int n1;
 
       begin_op();
       ilock(f->ip);
+      n1 = writeimax(f->off, n - i);
       if ((r = writei(f->ip, 1, addr + i, f->off, n1)) > 0)
         f->off += r;
       iunlock(f->ip);
@@ -27,6 +27,13 @@ struct inode {
   short nlink;
   uint size;
   uint addrs[NDIRECT+2];
+  uint delayed;       // 尚未分配磁盘块的直接块位图
+
+  // 供istat()无锁读取的元数据快照，由seq保护
+  struct seqlock seq;
+  short stype;
+  short snlink;
+  uint ssize;
 };
 
 // map major device number to device functions.
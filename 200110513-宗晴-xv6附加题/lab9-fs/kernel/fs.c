@@ -22,6 +22,7 @@
 #include "file.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define NRUN 16  // readi/writei每次批量映射的最大块数
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -162,17 +163,20 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
+// The icache.lock reader-writer lock protects the allocation of
+// icache entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold icache.lock while using any of those fields.
+// Holders of the read lock may only look up entries and take a
+// reference with an atomic increment of ip->ref; everything else,
+// including dropping a reference, needs the write lock.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct inode inode[NINODE];
 } icache;
 
@@ -181,9 +185,10 @@ iinit()
 {
   int i = 0;
   
-  initlock(&icache.lock, "icache");
+  initrwlock(&icache.lock, "icache");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
+    initseqlock(&icache.inode[i].seq, "inode seq");
   }
 }
 
@@ -214,6 +219,32 @@ ialloc(uint dev, short type)
   panic("ialloc: no inodes");
 }
 
+// Publish ip's type, nlink and size for lock-free istat()
+// readers. Caller must hold ip->lock.
+static void
+ipublish(struct inode *ip)
+{
+  writeseqlock(&ip->seq);
+  ip->stype = ip->type;
+  ip->snlink = ip->nlink;
+  ip->ssize = ip->size;
+  writesequnlock(&ip->seq);
+}
+
+// Size of ip as recorded on disk: the file stops before its
+// first delayed block, which has no disk block yet.
+static uint
+idisksize(struct inode *ip)
+{
+  uint bn;
+
+  for(bn = 0; bn < NDIRECT; bn++){
+    if(ip->delayed & (1 << bn))
+      return min(ip->size, bn * BSIZE);
+  }
+  return ip->size;
+}
+
 // Copy a modified in-memory inode to disk.
 // Must be called after every change to an ip->xxx field
 // that lives on disk, since i-node cache is write-through.
@@ -230,10 +261,11 @@ iupdate(struct inode *ip)
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
+  dip->size = idisksize(ip);
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
+  ipublish(ip);
 }
 
 // Find the inode with number inum on device dev
@@ -244,17 +276,32 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&icache.lock);
-
   // Is the inode already cached?
+  // An entry with delayed blocks stays cached (and valid)
+  // even without references, until iflushall() writes it.
+  // Entries are only recycled under the write lock, so a match
+  // found under the read lock stays valid.
+  acquireread(&icache.lock);
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    if((ip->ref > 0 || ip->delayed) && ip->dev == dev && ip->inum == inum){
+      __sync_fetch_and_add(&ip->ref, 1);
+      releaseread(&icache.lock);
+      return ip;
+    }
+  }
+  releaseread(&icache.lock);
+
+  // Not cached: look again under the write lock, since another
+  // CPU may have added it in between.
+  acquirewrite(&icache.lock);
   empty = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+    if((ip->ref > 0 || ip->delayed) && ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&icache.lock);
+      releasewrite(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
+    if(empty == 0 && ip->ref == 0 && ip->delayed == 0)    // Remember empty slot.
       empty = ip;
   }
 
@@ -267,7 +314,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&icache.lock);
+  releasewrite(&icache.lock);
 
   return ip;
 }
@@ -277,9 +324,9 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  acquireread(&icache.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
+  releaseread(&icache.lock);
   return ip;
 }
 
@@ -306,6 +353,8 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ipublish(ip);
+    __sync_synchronize();
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -332,7 +381,7 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&icache.lock);
+  acquirewrite(&icache.lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -341,7 +390,7 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&icache.lock);
+    releasewrite(&icache.lock);
 
     itrunc(ip);
     ip->type = 0;
@@ -350,11 +399,11 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&icache.lock);
+    acquirewrite(&icache.lock);
   }
 
   ip->ref--;
-  release(&icache.lock);
+  releasewrite(&icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -372,6 +421,18 @@ iunlockput(struct inode *ip)
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Small T_FILE and T_SYMLINK inodes keep their content inline in
+// ip->addrs[] instead (see NINLINE); bmap() must not be used on them.
+
+static void ifreeblocks(struct inode*);
+
+// 文件内容是否内联存放在addrs[]中
+static int
+iinline(struct inode *ip)
+{
+  return (ip->type == T_FILE || ip->type == T_SYMLINK) && ip->size <= NINLINE;
+}
+
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
 // 从磁盘上查找文件数据，获取inode中的第bn个块的块号
@@ -431,16 +492,100 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Like bmap(), but map the n consecutive blocks starting at bn
+// into addrs[], allocating any that are missing. Each indirect
+// block is read once per run instead of once per data block.
+// 批量映射一段连续的逻辑块，避免每个块都重新读取一次索引块
+static void
+bmaprun(struct inode *ip, uint bn, uint *addrs, int n)
+{
+  int i = 0;
+  uint addr, b, *a;
+  struct buf *bp;
+
+  // 延迟分配的块还没有磁盘块号，记为0
+  for(; i < n && bn < NDIRECT; i++, bn++)
+    addrs[i] = (ip->delayed & (1 << bn)) ? 0 : bmap(ip, bn);
+
+  // 一级索引
+  if(i < n && bn < NDIRECT + NINDIRECT){
+    if((addr = ip->addrs[NDIRECT]) == 0)
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    for(; i < n && bn < NDIRECT + NINDIRECT; i++, bn++){
+      if((addr = a[bn - NDIRECT]) == 0){
+        a[bn - NDIRECT] = addr = balloc(ip->dev);
+        log_write(bp);
+      }
+      addrs[i] = addr;
+    }
+    brelse(bp);
+  }
+
+  // 二级索引，每个叶子索引块只读取一次
+  while(i < n){
+    b = bn - NDIRECT - NINDIRECT;
+    if(b >= NINDIRECT * NINDIRECT)
+      panic("bmaprun: out of range");
+    if((addr = ip->addrs[NDIRECT + 1]) == 0)
+      ip->addrs[NDIRECT + 1] = addr = balloc(ip->dev);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[b/NINDIRECT]) == 0){
+      a[b/NINDIRECT] = addr = balloc(ip->dev);
+      log_write(bp);
+    }
+    brelse(bp);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    do {
+      if((addr = a[b % NINDIRECT]) == 0){
+        a[b % NINDIRECT] = addr = balloc(ip->dev);
+        log_write(bp);
+      }
+      addrs[i] = addr;
+      i++, bn++, b++;
+    } while(i < n && b % NINDIRECT != 0);
+    brelse(bp);
+  }
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 // 释放文件的所有块
 void
 itrunc(struct inode *ip)
+{
+  // 内联文件没有数据块，addrs[]中存放的是文件内容
+  if(iinline(ip))
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+  else
+    ifreeblocks(ip);
+
+  ip->size = 0;
+  iupdate(ip);
+}
+
+// Free all data and index blocks of a block-mode inode
+// and clear ip->addrs[]. Does not touch ip->size.
+static void
+ifreeblocks(struct inode *ip)
 {
   int i, j;
   struct buf *bp;
   uint *a;
 
+  // 延迟分配的块直接丢弃，不产生任何磁盘写
+  for(i = 0; i < NDIRECT; i++){
+    if(ip->delayed & (1 << i)){
+      bp = bgetdelay(ip, i, 0);
+      bundelay(bp);
+      brelse(bp);
+    }
+  }
+  ip->delayed = 0;
+
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
       bfree(ip->dev, ip->addrs[i]);
@@ -480,9 +625,43 @@ itrunc(struct inode *ip)
     bfree(ip->dev, ip->addrs[NDIRECT+1]);
     ip->addrs[NDIRECT + 1] = 0;
   }
+}
 
-  ip->size = 0;
-  iupdate(ip);
+// Move the inline content of ip into a freshly allocated
+// data block 0, so that ip can grow in block mode.
+// Caller must hold ip->lock and be inside a transaction.
+static void
+iexpand(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+
+  memmove(data, ip->addrs, NINLINE);
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  if(ip->size == 0)
+    return;
+  bp = bread(ip->dev, bmap(ip, 0));
+  memmove(bp->data, data, ip->size);
+  log_write(bp);
+  brelse(bp);
+}
+
+// Undo iexpand(): ip holds at most NINLINE bytes in block 0,
+// so copy them back into ip->addrs[] and free the blocks that
+// writei() may have allocated.
+static void
+ishrink(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+
+  if(ip->size > 0){
+    bp = bread(ip->dev, ip->addrs[0]);
+    memmove(data, bp->data, ip->size);
+    brelse(bp);
+  }
+  ifreeblocks(ip);
+  memmove(ip->addrs, data, ip->size);
 }
 
 // Copy stat information from inode.
@@ -497,6 +676,30 @@ stati(struct inode *ip, struct stat *st)
   st->size = ip->size;
 }
 
+// Copy stat information from inode without locking it,
+// using the snapshot published by iupdate() and ilock().
+// The caller must hold a reference to ip.
+// Returns -1 if ip has not been read from disk yet; the
+// caller must then fall back to ilock() and stati().
+int
+istat(struct inode *ip, struct stat *st)
+{
+  uint seq;
+
+  __sync_synchronize();
+  if(ip->valid == 0)
+    return -1;
+  do {
+    seq = readseqbegin(&ip->seq);
+    st->type = ip->stype;
+    st->nlink = ip->snlink;
+    st->size = ip->ssize;
+  } while(readseqretry(&ip->seq, seq));
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  return 0;
+}
+
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
@@ -504,7 +707,8 @@ stati(struct inode *ip, struct stat *st)
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addrs[NRUN];
+  int i, nb;
   struct buf *bp;
 
   if(off > ip->size || off + n < off)
@@ -512,19 +716,114 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
+  if(iinline(ip)){
+    if(either_copyout(user_dst, dst, (char*)ip->addrs + off, n) == -1)
+      return -1;
+    return n;
+  }
+
+  for(tot=0; tot<n; ){
+    nb = min((off%BSIZE + n - tot + BSIZE - 1) / BSIZE, NRUN);
+    bmaprun(ip, off/BSIZE, addrs, nb);
+    for(i = 0; i < nb; i++, tot+=m, off+=m, dst+=m){
+      bp = addrs[i] ? bread(ip->dev, addrs[i]) : bgetdelay(ip, off/BSIZE, 0);
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
+        brelse(bp);
+        return -1;
+      }
       brelse(bp);
-      tot = -1;
-      break;
     }
-    brelse(bp);
   }
   return tot;
 }
 
+// Delay the allocation of the not yet allocated direct blocks
+// among the n blocks starting at bn, as long as delayed buffers
+// are available; the rest are allocated by bmaprun() as usual.
+// Only regular files are delayed.
+// 新写入的数据先留在缓存中，由iflushall()统一分配磁盘块，
+// 短命的临时文件在删除前往往不需要分配任何磁盘块
+static void
+idelay(struct inode *ip, uint bn, int n)
+{
+  struct buf *bp;
+
+  if(ip->type != T_FILE)
+    return;
+  for(; n > 0 && bn < NDIRECT; n--, bn++){
+    if(ip->addrs[bn] || (ip->delayed & (1 << bn)))
+      continue;
+    if((bp = bgetdelay(ip, bn, 1)) == 0)
+      return;
+    brelse(bp);
+    ip->delayed |= 1 << bn;
+  }
+}
+
+// Give up to max delayed blocks of ip real disk blocks.
+// Blocks are allocated in file order, so balloc()'s first-fit
+// search tends to lay them out contiguously.
+// Caller must hold ip->lock and be inside a transaction.
+static void
+iflush(struct inode *ip, int max)
+{
+  uint bn, addr;
+  struct buf *bp, *dbp;
+
+  for(bn = 0; bn < NDIRECT && max > 0; bn++){
+    if((ip->delayed & (1 << bn)) == 0)
+      continue;
+    dbp = bgetdelay(ip, bn, 0);
+    addr = balloc(ip->dev);
+    bp = bread(ip->dev, addr);
+    memmove(bp->data, dbp->data, BSIZE);
+    log_write(bp);
+    brelse(bp);
+    bundelay(dbp);
+    brelse(dbp);
+    ip->addrs[bn] = addr;
+    ip->delayed &= ~(1 << bn);
+    max--;
+  }
+  iupdate(ip);
+}
+
+// Allocate disk blocks for the delayed blocks of every cached
+// inode, each in as few transactions as the log allows.
+// Unlinked inodes are skipped: their last iput() discards them.
+// Must not be called inside a transaction.
+void
+iflushall(void)
+{
+  struct inode *ip;
+  int more;
+
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    acquirewrite(&icache.lock);
+    if(ip->delayed == 0){
+      releasewrite(&icache.lock);
+      continue;
+    }
+    ip->ref++;
+    releasewrite(&icache.lock);
+
+    do {
+      begin_op();
+      ilock(ip);
+      if(ip->nlink > 0)
+        iflush(ip, MAXOPBLOCKS-1-2);
+      more = ip->delayed && ip->nlink > 0;
+      iunlock(ip);
+      end_op();
+    } while(more);
+
+    begin_op();
+    iput(ip);
+    end_op();
+  }
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -535,28 +834,56 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 int
 writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 {
-  uint tot, m;
+  uint tot, m, addrs[NRUN];
+  int i, nb;
   struct buf *bp;
+  int expanded = 0;
 
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+  if(iinline(ip)){
+    if(off + n <= NINLINE){
+      if(either_copyin((char*)ip->addrs + off, user_src, src, n) == -1)
+        return -1;
+      if(off + n > ip->size)
+        ip->size = off + n;
+      iupdate(ip);
+      return n;
+    }
+    // 写入后超出内联容量，先把已有内容搬到第0个数据块，转为块索引方式
+    iexpand(ip);
+    expanded = 1;
+  }
+
+  for(tot=0; tot<n; ){
+    nb = min((off%BSIZE + n - tot + BSIZE - 1) / BSIZE, NRUN);
+    idelay(ip, off/BSIZE, nb);
+    bmaprun(ip, off/BSIZE, addrs, nb);
+    for(i = 0; i < nb; i++, tot+=m, off+=m, src+=m){
+      bp = addrs[i] ? bread(ip->dev, addrs[i]) : bgetdelay(ip, off/BSIZE, 0);
+      m = min(n - tot, BSIZE - off%BSIZE);
+      if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
+        brelse(bp);
+        goto out;
+      }
+      if(addrs[i])
+        log_write(bp);
       brelse(bp);
-      break;
     }
-    log_write(bp);
-    brelse(bp);
   }
 
+out:
+
   if(off > ip->size)
     ip->size = off;
 
+  // 拷贝出错导致文件仍未超出内联容量，退回内联方式，避免addrs[]被误当作内容
+  if(expanded && ip->size <= NINLINE)
+    ishrink(ip);
+
   // write the i-node back to disk even if the size didn't change
   // because the loop above might have called bmap() and added a new
   // block to ip->addrs[].
@@ -565,6 +892,38 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// Return how many of the n bytes at offset off one writei()
+// can write inside a single transaction. Each data block costs
+// one log block, plus the index blocks the range touches, the
+// i-node, and up to two bitmap blocks for allocation.
+// 按写入区间实际涉及的索引块计算，而不是按最坏情况统一切分
+uint
+writeimax(uint off, uint n)
+{
+  uint bn, b, end, cost, budget;
+
+  budget = MAXOPBLOCKS - 1 - 2;
+  end = off;
+  for(bn = off/BSIZE; end < off + n; bn++){
+    cost = 1;
+    if(bn >= NDIRECT && bn < NDIRECT + NINDIRECT){
+      if(bn == off/BSIZE || bn == NDIRECT)
+        cost++;  // 一级索引块
+    } else if(bn >= NDIRECT + NINDIRECT){
+      b = bn - NDIRECT - NINDIRECT;
+      if(bn == off/BSIZE || b == 0)
+        cost++;  // 二级索引的根块
+      if(bn == off/BSIZE || b % NINDIRECT == 0)
+        cost++;  // 二级索引的叶子块
+    }
+    if(cost > budget)
+      break;
+    budget -= cost;
+    end = (bn + 1) * BSIZE;
+  }
+  return min(end, off + n) - off;
+}
+
 // Directories
 
 int
@@ -38,6 +38,10 @@ struct dinode {
   uint addrs[NDIRECT+2];   // Data block addresses
 };
 
+// 小文件(T_FILE/T_SYMLINK)的内容不超过NINLINE字节时，直接内联存放在addrs[]中，
+// 不分配数据块；是否内联由type和size决定，mkfs写入的文件需遵循同样的规则
+#define NINLINE ((NDIRECT+2) * sizeof(uint))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
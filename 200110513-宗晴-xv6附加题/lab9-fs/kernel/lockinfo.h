@@ -0,0 +1,9 @@
+// Per-lock contention statistics returned by lockstat().
+struct lockinfo {
+  char name[16];
+  int sleeplock;      // 1 for a sleep lock
+  uint64 nacquire;    // acquisitions
+  uint64 ncontend;    // acquisitions that had to wait
+  uint64 nsleep;      // sleep locks: waits that had to sleep
+  uint64 nspin;       // time spent waiting, in time CSR units
+};
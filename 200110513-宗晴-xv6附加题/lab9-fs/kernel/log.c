@@ -29,6 +29,13 @@
 //   block C
 //   ...
 // Log appends are synchronous.
+//
+// end_op() normally does not commit. The flusher kernel thread
+// (logflusher(), started by main()) commits every FLUSHTICKS
+// ticks, so a system call only pays for its own log space.
+// end_op() still commits at once when the log could not admit
+// another operation, rather than making begin_op() wait for
+// the flusher.
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
@@ -43,6 +50,7 @@ struct log {
   int size;
   int outstanding; // how many FS sys calls are executing.
   int committing;  // in commit(), please wait.
+  int started;     // initlog() has recovered the log.
   int dev;
   struct logheader lh;
 };
@@ -62,6 +70,8 @@ initlog(int dev, struct superblock *sb)
   log.size = sb->nlog;
   log.dev = dev;
   recover_from_log();
+  __sync_synchronize();
+  log.started = 1;
 }
 
 // Copy committed blocks from log to their home location
@@ -142,7 +152,8 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// commits if this was the last outstanding operation
+// and the log has no room left for another one.
 void
 end_op(void)
 {
@@ -150,15 +161,15 @@ end_op(void)
 
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
+  if(!log.committing && log.outstanding == 0 &&
+     log.lh.n + MAXOPBLOCKS > LOGSIZE){
     do_commit = 1;
     log.committing = 1;
   } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
+    // begin_op() may be waiting for log space, and
+    // the flusher may be waiting for outstanding ops
+    // to drain; decrementing log.outstanding has
+    // decreased the amount of reserved space.
     wakeup(&log);
   }
   release(&log.lock);
@@ -174,6 +185,42 @@ end_op(void)
   }
 }
 
+// The flusher kernel thread. Every FLUSHTICKS ticks it gives
+// delayed blocks their disk blocks, then stops new operations,
+// waits for the outstanding ones and commits the log.
+void
+logflusher(void)
+{
+  // 文件系统由第一个用户进程在forkret()中初始化
+  while(!log.started)
+    sleepuntil(r_time() + TICKCYCLES);
+
+  for(;;){
+    sleepuntil(r_time() + FLUSHTICKS * TICKCYCLES);
+
+    iflushall();
+
+    acquire(&log.lock);
+    while(log.committing)
+      sleep(&log, &log.lock);
+    if(log.lh.n == 0){
+      release(&log.lock);
+      continue;
+    }
+    log.committing = 1;  // begin_op()不再接纳新的操作
+    while(log.outstanding > 0)
+      sleep(&log, &log.lock);
+    release(&log.lock);
+
+    commit();
+
+    acquire(&log.lock);
+    log.committing = 0;
+    wakeup(&log);
+    release(&log.lock);
+  }
+}
+
 // Copy modified blocks from cache to log.
 static void
 write_log(void)
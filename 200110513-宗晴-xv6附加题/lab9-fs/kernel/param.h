@@ -4,6 +4,17 @@
 #define NPROC        64  // maximum number of processes (speedsup bigfile)
 #endif
 #define NCPU          8  // maximum number of CPUs
+#define NWAITQ       64  // number of sleep/wakeup hash buckets
+#define NPIDHASH     64  // number of pid lookup hash buckets
+#define NLOCK       500  // maximum number of locks tracked by lockstat()
+#define NPRIO         3  // number of MLFQ priority levels
+#define BOOSTTICKS   50  // ticks between MLFQ priority boosts
+#ifndef TICKCYCLES
+#define TICKCYCLES   1000000  // timer interval in cycles; about 1/10th second in qemu
+#endif
+#define IDLETICKS    10  // max ticks an idle CPU's timer may skip
+#define SPINWAIT     200  // max time CSR units acquiresleep() spins (20us)
+#define TIMEBASE     10000000  // frequency of the time CSR in qemu (Hz)
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
 #define NINODE       50  // maximum number of active i-nodes
@@ -12,7 +23,9 @@
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
+#define NDELAY       10  // max delayed-allocation blocks held in the cache
+#define NBUF         (MAXOPBLOCKS*6+NDELAY)  // size of disk block cache
+#define FLUSHTICKS   3   // ticks between background log commits
 #define FSSIZE       200000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
 
@@ -4,6 +4,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "procinfo.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
@@ -13,11 +14,60 @@ struct proc proc[NPROC];
 struct proc *initproc;
 
 int nextpid = 1;
-struct spinlock pid_lock;
+
+// UNUSED proc slots, linked through p->freenext, so that
+// allocproc() does not scan proc[].
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} freeprocs;
+
+// Allocated processes hashed by pid, linked through p->pidnext.
+// A process is in its bucket from allocproc() until freeproc().
+// Lock order: p->lock, then a bucket's lock.
+struct pidbucket {
+  struct spinlock lock;
+  struct proc *head;
+} pidhash[NPIDHASH];
+
+#define PIDHASH(pid) (&pidhash[(uint)(pid) % NPIDHASH])
+
+// Children abandoned by exiting processes, linked through
+// p->sibling, until init's wait() takes them into its own
+// children list. exit() cannot lock initproc to do that itself.
+// Lock order: any p->lock, then orphans.lock.
+struct {
+  struct spinlock lock;
+  struct proc *head;
+} orphans;
+
+// Sleeping processes, hashed by wait channel, so that wakeup()
+// only looks at the processes that may sleep on its channel.
+// A process is in the bucket of p->chan from just before it
+// sleeps until it has been woken up and is running again.
+// Lock order: p->lock, then a bucket's lock; wakeup() never
+// holds a bucket's lock while acquiring a p->lock.
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+} waitq[NWAITQ];
+
+#define WAITQ(chan) (&waitq[(((uint64)(chan)) >> 3) % NWAITQ])
+
+// Processes in sleepuntil(), in a min-heap ordered by p->wakeat,
+// so that timerexpire() only looks at the earliest deadlines.
+// p->theap is p's index in heap[], or -1.
+struct {
+  struct spinlock lock;
+  struct proc *heap[NPROC];
+  int n;
+} timers;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static void setrunnable(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 
@@ -43,11 +93,23 @@ void
 procinit(void)
 {
   struct proc *p;
+  struct cpu *c;
+  int i;
   
-  initlock(&pid_lock, "nextpid");
-  for(p = proc; p < &proc[NPROC]; p++) {
+  initlock(&freeprocs.lock, "freeprocs");
+  initlock(&orphans.lock, "orphans");
+  for(i = 0; i < NPIDHASH; i++)
+    initlock(&pidhash[i].lock, "pidhash");
+  for(i = 0; i < NWAITQ; i++)
+    initlock(&waitq[i].lock, "waitq");
+  initlock(&timers.lock, "timers");
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    initlock(&c->rqlock, "runq");
+  for(p = &proc[NPROC-1]; p >= proc; p--) {
       initlock(&p->lock, "proc");
       p->kstack = KSTACK((int) (p - proc));
+      p->freenext = freeprocs.head;
+      freeprocs.head = p;
   }
 }
 
@@ -82,17 +144,38 @@ myproc(void) {
 
 int
 allocpid() {
-  int pid;
-  
-  acquire(&pid_lock);
-  pid = nextpid;
-  nextpid = nextpid + 1;
-  release(&pid_lock);
+  // 原子加，不需要全局锁
+  return __sync_fetch_and_add(&nextpid, 1);
+}
 
-  return pid;
+// Find the process with the given pid.
+// Returns with p->lock held, or 0 if there is none.
+static struct proc*
+findproc(int pid)
+{
+  struct pidbucket *b = PIDHASH(pid);
+  struct proc *p;
+
+  acquire(&b->lock);
+  for(p = b->head; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+  release(&b->lock);
+  if(p == 0)
+    return 0;
+
+  // p may have been freed, and even reused, once the bucket
+  // lock was released; pids are never reused, so checking the
+  // pid again under p->lock is enough.
+  acquire(&p->lock);
+  if(p->pid != pid){
+    release(&p->lock);
+    return 0;
+  }
+  return p;
 }
 
-// Look in the process table for an UNUSED proc.
+// Take an UNUSED proc off the free list.
 // If found, initialize state required to run in the kernel,
 // and return with p->lock held.
 // If there are no free procs, or a memory allocation fails, return 0.
@@ -100,22 +183,33 @@ static struct proc*
 allocproc(void)
 {
   struct proc *p;
+  struct pidbucket *b;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  acquire(&freeprocs.lock);
+  if((p = freeprocs.head) != 0)
+    freeprocs.head = p->freenext;
+  release(&freeprocs.lock);
+  if(p == 0)
+    return 0;
 
-found:
+  // 已不在空闲链表中，其他CPU拿不到p
+  acquire(&p->lock);
   p->pid = allocpid();
+  b = PIDHASH(p->pid);
+  acquire(&b->lock);
+  p->pidnext = b->head;
+  b->head = p;
+  release(&b->lock);
+  p->lastcpu = cpuid();  // 新进程先排在创建它的CPU上
+  p->prio = p->baseprio = 0;
+  p->slice = 0;
+  p->boost = ticks / BOOSTTICKS;
+  p->rtime = 0;
+  p->theap = -1;
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
@@ -138,11 +232,23 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
+// including user pages, and put it back on the free list.
 // p->lock must be held.
 static void
 freeproc(struct proc *p)
 {
+  struct pidbucket *b = PIDHASH(p->pid);
+  struct proc **pp;
+
+  acquire(&b->lock);
+  for(pp = &b->head; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&b->lock);
+
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
@@ -152,11 +258,19 @@ freeproc(struct proc *p)
   p->sz = 0;
   p->pid = 0;
   p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
   p->name[0] = 0;
   p->chan = 0;
   p->killed = 0;
   p->xstate = 0;
+  p->kfunc = 0;
   p->state = UNUSED;
+
+  acquire(&freeprocs.lock);
+  p->freenext = freeprocs.head;
+  freeprocs.head = p;
+  release(&freeprocs.lock);
 }
 
 // Create a user page table for a given process,
@@ -235,11 +349,28 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
+// Start a kernel thread that runs fn, which must not return.
+// The thread has its own process slot and kernel stack, but
+// never runs user code and has no parent.
+void
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kthread");
+  p->kfunc = fn;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  setrunnable(p);
+  release(&p->lock);
+}
+
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -298,38 +429,50 @@ fork(void)
 
   safestrcpy(np->name, p->name, sizeof(p->name));
 
+  np->prio = np->baseprio = p->baseprio;
+
   pid = np->pid;
 
-  np->state = RUNNABLE;
+  release(&np->lock);
 
+  // the parent-then-child rule keeps fork from taking p->lock
+  // while holding np->lock. np is not runnable yet, so it
+  // cannot exit before it is on the list.
+  acquire(&p->lock);
+  np->sibling = p->children;
+  p->children = np;
+  release(&p->lock);
+
+  acquire(&np->lock);
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
-// Pass p's abandoned children to init.
+// Pass p's abandoned children to init, through the orphans list.
+// Each child is on the list before its parent becomes init, so
+// the wakeup its exit() sends init comes when init can find it.
 // Caller must hold p->lock.
 void
 reparent(struct proc *p)
 {
   struct proc *pp;
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    // this code uses pp->parent without holding pp->lock.
-    // acquiring the lock first could cause a deadlock
-    // if pp or a child of pp were also in exit()
-    // and about to try to lock p.
-    if(pp->parent == p){
-      // pp->parent can't change between the check and the acquire()
-      // because only the parent changes it, and we're the parent.
-      acquire(&pp->lock);
-      pp->parent = initproc;
-      // we should wake up init here, but that would require
-      // initproc->lock, which would be a deadlock, since we hold
-      // the lock on one of init's children (pp). this is why
-      // exit() always wakes init (before acquiring any locks).
-      release(&pp->lock);
-    }
+  while((pp = p->children) != 0){
+    // the parent-then-child rule allows this, since we're the parent.
+    acquire(&pp->lock);
+    p->children = pp->sibling;
+    acquire(&orphans.lock);
+    pp->sibling = orphans.head;
+    orphans.head = pp;
+    release(&orphans.lock);
+    pp->parent = initproc;
+    // we should wake up init here, but that would require
+    // initproc->lock, which would be a deadlock, since we hold
+    // the lock on one of init's children (p). this is why
+    // exit() always wakes init (before acquiring any locks).
+    release(&pp->lock);
   }
 }
 
@@ -404,8 +547,8 @@ exit(int status)
 int
 wait(uint64 addr)
 {
-  struct proc *np;
-  int havekids, pid;
+  struct proc *np, **pp, *last;
+  int pid;
   struct proc *p = myproc();
 
   // hold p->lock for the whole time to avoid lost
@@ -413,37 +556,41 @@ wait(uint64 addr)
   acquire(&p->lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      // this code uses np->parent without holding np->lock.
-      // acquiring the lock first would cause a deadlock,
-      // since np might be an ancestor, and we already hold p->lock.
-      if(np->parent == p){
-        // np->parent can't change between the check and the acquire()
-        // because only the parent changes it, and we're the parent.
-        acquire(&np->lock);
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
-          freeproc(np);
+    if(p == initproc && orphans.head){
+      // 领养其他进程退出时留下的子进程
+      acquire(&orphans.lock);
+      for(last = orphans.head; last->sibling; last = last->sibling)
+        ;
+      last->sibling = p->children;
+      p->children = orphans.head;
+      orphans.head = 0;
+      release(&orphans.lock);
+    }
+
+    // Look through our children for exited ones.
+    for(pp = &p->children; (np = *pp) != 0; pp = &np->sibling){
+      // the parent-then-child rule allows this, since we're the parent.
+      acquire(&np->lock);
+      if(np->state == ZOMBIE){
+        // Found one.
+        pid = np->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                                sizeof(np->xstate)) < 0) {
           release(&np->lock);
           release(&p->lock);
-          return pid;
+          return -1;
         }
+        *pp = np->sibling;
+        freeproc(np);
         release(&np->lock);
+        release(&p->lock);
+        return pid;
       }
+      release(&np->lock);
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
+    if(p->children == 0 || p->killed){
       release(&p->lock);
       return -1;
     }
@@ -453,10 +600,108 @@ wait(uint64 addr)
   }
 }
 
+// Per-CPU run queues.
+//
+// Each CPU keeps NPRIO FIFOs of RUNNABLE processes, one per
+// priority level, linked through p->rqnext and protected by
+// c->rqlock. A process is on a run queue exactly when it is
+// RUNNABLE and no scheduler has picked it yet, so scheduling
+// cost does not depend on NPROC.
+// Lock order: p->lock, then c->rqlock.
+//
+// The levels form a multilevel feedback queue: a process that
+// uses up its time slice at level l (1<<l ticks, see proctick())
+// moves down one level, and every BOOSTTICKS ticks all processes
+// return to the level set by setpriority(). Interactive processes
+// that mostly sleep therefore stay ahead of CPU-bound ones.
+
+// Append p to c's run queue for its level.
+// If c is another CPU that is idle in wfi, append p to this
+// CPU's queue instead: nothing would wake c before its slowed
+// idle timer (see timeridle()) fires.
+// Caller must hold p->lock.
+static void
+rqpush(struct cpu *c, struct proc *p)
+{
+  uint epoch = ticks / BOOSTTICKS;
+
+  // 周期性提升优先级，避免低级别进程饿死
+  if(p->boost != epoch){
+    p->boost = epoch;
+    p->prio = p->baseprio;
+    p->slice = 0;
+  }
+
+  acquire(&c->rqlock);
+  if(c->idle && c != mycpu()){
+    release(&c->rqlock);
+    c = mycpu();
+    acquire(&c->rqlock);
+  }
+  p->rqnext = 0;
+  if(c->rqtail[p->prio])
+    c->rqtail[p->prio]->rqnext = p;
+  else
+    c->rqhead[p->prio] = p;
+  c->rqtail[p->prio] = p;
+  c->nrun++;
+  release(&c->rqlock);
+}
+
+// Remove and return the first process of the highest
+// non-empty level of c's run queue, or 0 if it is empty.
+static struct proc*
+rqpop(struct cpu *c)
+{
+  struct proc *p = 0;
+  int l;
+
+  // 不加锁先看一眼，避免空闲CPU反复争抢其他CPU的队列锁
+  if(c->nrun == 0)
+    return 0;
+  acquire(&c->rqlock);
+  for(l = 0; l < NPRIO; l++){
+    if((p = c->rqhead[l]) != 0){
+      c->rqhead[l] = p->rqnext;
+      if(c->rqhead[l] == 0)
+        c->rqtail[l] = 0;
+      p->rqnext = 0;
+      c->nrun--;
+      break;
+    }
+  }
+  release(&c->rqlock);
+  return p;
+}
+
+// Take work from another CPU's run queue, when c's is empty.
+static struct proc*
+rqsteal(struct cpu *c)
+{
+  struct proc *p;
+  int i, id = c - cpus;
+
+  for(i = 1; i < NCPU; i++){
+    if((p = rqpop(&cpus[(id + i) % NCPU])) != 0)
+      return p;
+  }
+  return 0;
+}
+
+// Mark p RUNNABLE and queue it on the CPU it last ran on.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  rqpush(&cpus[p->lastcpu], p);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run from this CPU's run queue,
+//    or steal one from another CPU.
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -470,34 +715,132 @@ scheduler(void)
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    
-    int nproc = 0;
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state != UNUSED) {
-        nproc++;
-      }
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+
+    if((p = rqpop(c)) == 0 && (p = rqsteal(c)) == 0){
+      // 没有可运行的进程，放慢本CPU的时钟，等待下一个中断。
+      // 在rqlock下确认队列为空后才标记空闲，此后rqpush()
+      // 不会再把进程排到本CPU上。
+      // 关中断直到下一轮循环：timeridle()要求中断关闭，
+      // 而wfi在中断关闭时仍会被挂起的中断唤醒
+      intr_off();
+      acquire(&c->rqlock);
+      if(c->nrun > 0){
+        release(&c->rqlock);
+        continue;
       }
-      release(&p->lock);
-    }
-    if(nproc <= 2) {   // only init and sh exist
-      intr_on();
+      c->idle = 1;
+      release(&c->rqlock);
+      timeridle(1);
       asm volatile("wfi");
+      acquire(&c->rqlock);
+      c->idle = 0;
+      release(&c->rqlock);
+      timeridle(0);
+      continue;
     }
+
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      p->lastcpu = c - cpus;
+      c->proc = p;
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
+
+      // yield()
+      if(p->state == RUNNABLE)
+        rqpush(c, p);
+    }
+    release(&p->lock);
   }
 }
 
+// Charge the current process for one clock tick.
+// Called on every CPU's timer interrupt.
+// Returns 1 if the process should yield the CPU: it has used
+// up its time slice, and moves down one level, or a process
+// of a higher level is waiting on this CPU.
+int
+proctick(void)
+{
+  struct proc *p = myproc();
+  struct cpu *c = mycpu();
+  int l, yield = 0;
+
+  if(p == 0)
+    return 0;
+  acquire(&p->lock);
+  p->rtime++;
+  if(++p->slice >= (1 << p->prio)){
+    if(p->prio < NPRIO-1)
+      p->prio++;
+    p->slice = 0;
+    yield = 1;
+  }
+  for(l = 0; l < p->prio; l++){
+    if(c->rqhead[l])
+      yield = 1;
+  }
+  release(&p->lock);
+  return yield;
+}
+
+// Set the base priority level of process pid; the process
+// also moves to that level right away.
+// Returns the old base level, or -1 if there is no such process.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+  int old;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  old = p->baseprio;
+  p->baseprio = p->prio = prio;
+  p->slice = 0;
+  release(&p->lock);
+  return old;
+}
+
+// Copy information about up to max live processes to the
+// user array of struct procinfo at addr.
+// Returns the number of entries copied, or -1 on error.
+int
+getprocs(uint64 addr, int max)
+{
+  struct proc *p;
+  struct procinfo pi;
+  int n = 0;
+
+  for(p = proc; p < &proc[NPROC] && n < max; p++){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      continue;
+    }
+    pi.pid = p->pid;
+    pi.state = p->state;
+    pi.prio = p->prio;
+    pi.baseprio = p->baseprio;
+    pi.rtime = p->rtime;
+    safestrcpy(pi.name, p->name, sizeof(pi.name));
+    release(&p->lock);
+    if(copyout(myproc()->pagetable, addr + n*sizeof(pi), (char*)&pi, sizeof(pi)) < 0)
+      return -1;
+    n++;
+  }
+  return n;
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -557,6 +900,18 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch to kthreadret.
+static void
+kthreadret(void)
+{
+  // Still holding p->lock from scheduler.
+  release(&myproc()->lock);
+
+  myproc()->kfunc();
+  panic("kthread return");
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
@@ -570,18 +925,37 @@ sleep(void *chan, struct spinlock *lk)
   // guaranteed that we won't miss any wakeup
   // (wakeup locks p->lock),
   // so it's okay to release lk.
-  if(lk != &p->lock){  //DOC: sleeplock0
+  // Enter chan's bucket before releasing lk, so that a
+  // wakeup() issued once lk is free will find p.
+  struct waitq *q = WAITQ(chan);
+
+  if(lk != &p->lock)  //DOC: sleeplock0
     acquire(&p->lock);  //DOC: sleeplock1
+  p->chan = chan;
+  acquire(&q->lock);
+  p->wqprev = 0;
+  p->wqnext = q->head;
+  if(q->head)
+    q->head->wqprev = p;
+  q->head = p;
+  release(&q->lock);
+  if(lk != &p->lock)
     release(lk);
-  }
 
   // Go to sleep.
-  p->chan = chan;
   p->state = SLEEPING;
 
   sched();
 
   // Tidy up.
+  acquire(&q->lock);
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    q->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  release(&q->lock);
   p->chan = 0;
 
   // Reacquire original lock.
@@ -596,17 +970,120 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *q = WAITQ(chan);
+  struct proc *p, *waiters[NPROC];
+  int i, n = 0;
+
+  // 先在桶中收集候选进程，释放桶锁后再逐个获取p->lock
+  acquire(&q->lock);
+  for(p = q->head; p; p = p->wqnext){
+    if(p->chan == chan)
+      waiters[n++] = p;
+  }
+  release(&q->lock);
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  for(i = 0; i < n; i++){
+    p = waiters[i];
     acquire(&p->lock);
     if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
+      setrunnable(p);
     }
     release(&p->lock);
   }
 }
 
+// Timer heap helpers. Caller must hold timers.lock.
+
+static void
+theapset(int i, struct proc *p)
+{
+  timers.heap[i] = p;
+  p->theap = i;
+}
+
+// Restore the heap order around index i.
+static void
+theapfix(int i)
+{
+  struct proc *p = timers.heap[i];
+  int c;
+
+  while(i > 0 && timers.heap[(i-1)/2]->wakeat > p->wakeat){
+    theapset(i, timers.heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  for(;;){
+    c = 2*i + 1;
+    if(c >= timers.n)
+      break;
+    if(c+1 < timers.n && timers.heap[c+1]->wakeat < timers.heap[c]->wakeat)
+      c++;
+    if(timers.heap[c]->wakeat >= p->wakeat)
+      break;
+    theapset(i, timers.heap[c]);
+    i = c;
+  }
+  theapset(i, p);
+}
+
+static void
+theapremove(struct proc *p)
+{
+  int i = p->theap;
+
+  p->theap = -1;
+  if(--timers.n == i)
+    return;
+  theapset(i, timers.heap[timers.n]);
+  theapfix(i);
+}
+
+// Sleep until the time CSR reaches when, or the process is killed.
+// Returns 0 when the deadline passed, -1 if killed.
+int
+sleepuntil(uint64 when)
+{
+  struct proc *p = myproc();
+
+  if(r_time() >= when)
+    return 0;
+
+  acquire(&timers.lock);
+  p->wakeat = when;
+  timers.n++;
+  theapset(timers.n - 1, p);
+  theapfix(timers.n - 1);
+  timerarm(when);
+  while(p->theap >= 0 && !p->killed)
+    sleep(&p->wakeat, &timers.lock);
+  if(p->theap >= 0)
+    theapremove(p);
+  release(&timers.lock);
+  return p->killed ? -1 : 0;
+}
+
+// Wake the processes whose sleepuntil() deadline has passed,
+// each exactly once, and arm this hart's timer for the next one.
+// Called from clockintr() on every hart.
+void
+timerexpire(void)
+{
+  uint64 now = r_time();
+  struct proc *p;
+
+  if(timers.n == 0)
+    return;
+  acquire(&timers.lock);
+  while(timers.n > 0 && timers.heap[0]->wakeat <= now){
+    p = timers.heap[0];
+    theapremove(p);
+    wakeup(&p->wakeat);
+  }
+  if(timers.n > 0)
+    timerarm(timers.heap[0]->wakeat);
+  release(&timers.lock);
+}
+
 // Wake up p if it is sleeping in wait(); used by exit().
 // Caller must hold p->lock.
 static void
@@ -615,32 +1092,33 @@ wakeup1(struct proc *p)
   if(!holding(&p->lock))
     panic("wakeup1");
   if(p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
+    setrunnable(p);
   }
 }
 
 // Kill the process with the given pid.
 // The victim won't exit until it tries to return
 // to user space (see usertrap() in trap.c).
+// Kernel threads never return to user space and cannot be killed.
 int
 kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
+  if((p = findproc(pid)) == 0)
+    return -1;
+  if(p->kfunc){
+    // 内核线程不会退出，killed只会让sleepuntil()等立即返回
     release(&p->lock);
+    return -1;
+  }
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -697,7 +1175,7 @@ procdump(void)
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    printf("%d %s %d %d %s", p->pid, state, p->prio, p->rtime, p->name);
     printf("\n");
   }
 }
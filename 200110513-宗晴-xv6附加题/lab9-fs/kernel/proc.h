@@ -24,6 +24,13 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+
+  // 本CPU的多级就绪队列，由rqlock保护，0级优先级最高
+  struct spinlock rqlock;
+  struct proc *rqhead[NPRIO]; // 各级队首，下一个被调度的进程
+  struct proc *rqtail[NPRIO];
+  int nrun;                   // 各级队列长度之和
+  int idle;                   // 队列为空，正在wfi中等待
 };
 
 extern struct cpu cpus[NCPU];
@@ -89,10 +96,25 @@ struct proc {
   // p->lock must be held when using these:
   enum procstate state;        // Process state
   struct proc *parent;         // Parent process
+  struct proc *children;       // 子进程链表
+  struct proc *sibling;        // 兄弟进程，由父进程的lock保护
   void *chan;                  // If non-zero, sleeping on chan
+  struct proc *wqnext;         // 同一等待队列桶中的进程，由桶的锁保护
+  struct proc *wqprev;
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  struct proc *rqnext;         // 就绪队列中的下一个进程
+  int lastcpu;                 // 上次运行所在的CPU
+  int prio;                    // 当前所在的MLFQ级别
+  int baseprio;                // setpriority()设定的级别，提升时回到该级别
+  int slice;                   // 在当前级别已用掉的时间片(ticks)
+  uint boost;                  // 上次提升优先级时的周期号
+  uint rtime;                  // 累计运行的ticks
+  uint64 wakeat;               // sleepuntil()的截止时间(time CSR)，由timers.lock保护
+  int theap;                   // 在定时器堆中的下标，-1表示不在堆中
+  struct proc *pidnext;        // 同一pid哈希桶中的进程，由桶的锁保护
+  struct proc *freenext;       // 空闲链表中的下一个槽位，由freeprocs.lock保护
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
@@ -103,4 +125,5 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfunc)(void);         // 内核线程的入口，用户进程为0
 };
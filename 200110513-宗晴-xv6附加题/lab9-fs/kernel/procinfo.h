@@ -0,0 +1,10 @@
+// Per-process information returned by getprocs(),
+// for ps-style tools.
+struct procinfo {
+  int pid;
+  int state;          // enum procstate in proc.h
+  int prio;           // current MLFQ level, 0 is highest
+  int baseprio;       // level set by setpriority()
+  uint rtime;         // clock ticks spent running
+  char name[16];
+};
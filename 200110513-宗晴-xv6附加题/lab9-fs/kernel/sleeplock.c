@@ -12,21 +12,57 @@
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
-  initlock(&lk->lk, "sleep lock");
+  initlock(&lk->lk, name);
+  lk->lk.sleeplock = lk;
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nsleep = 0;
+  lk->waittime = 0;
 }
 
+// Acquire the lock, adaptively: while the holder is running
+// on another CPU it will likely release the lock soon, so spin
+// for up to SPINWAIT rather than sleep and switch. Sleep once
+// the holder blocks or is descheduled, or the time is up.
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *owner;
+  uint64 t0 = 0;
+  int slept = 0;
+
   acquire(&lk->lk);
+  if(lk->locked)
+    t0 = r_time();
   while (lk->locked) {
+    owner = lk->owner;
+    if(owner && owner->state == RUNNING && r_time() < t0 + SPINWAIT){
+      // 不持有lk自旋，持有者才能释放；proc[]不会被释放，读owner是安全的
+      release(&lk->lk);
+      while(__atomic_load_n(&lk->locked, __ATOMIC_RELAXED) &&
+            __atomic_load_n(&lk->owner, __ATOMIC_RELAXED) == owner &&
+            __atomic_load_n(&owner->state, __ATOMIC_RELAXED) == RUNNING &&
+            r_time() < t0 + SPINWAIT)
+        ;
+      acquire(&lk->lk);
+      continue;
+    }
+    slept = 1;
     sleep(lk, &lk->lk);
   }
   lk->locked = 1;
+  lk->owner = myproc();
   lk->pid = myproc()->pid;
+  lk->nacquire++;
+  if(t0){
+    lk->ncontend++;
+    lk->nsleep += slept;
+    lk->waittime += r_time() - t0;
+  }
   release(&lk->lk);
 }
 
@@ -35,6 +71,7 @@ releasesleep(struct sleeplock *lk)
 {
   acquire(&lk->lk);
   lk->locked = 0;
+  lk->owner = 0;
   lk->pid = 0;
   wakeup(lk);
   release(&lk->lk);
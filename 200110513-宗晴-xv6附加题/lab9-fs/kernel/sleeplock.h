@@ -2,9 +2,15 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  struct proc *owner; // Process holding lock, for acquiresleep() spinning
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
-};
 
+  // 等待统计，由lk保护，由lockstat()读出
+  uint64 nacquire;   // acquiresleep()次数
+  uint64 ncontend;   // 需要等待的次数
+  uint64 nsleep;     // 其中自旋后仍需sleep()的次数
+  uint64 waittime;   // 等待的时间(time CSR)
+};
@@ -6,37 +6,93 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "sleeplock.h"
 #include "defs.h"
+#include "lockinfo.h"
+
+// Every initialized lock, for lockstat(). Locks living in
+// kalloc()ed memory must be removed with freelock().
+static struct spinlock lock_locks;
+static struct spinlock *locks[NLOCK];
+
+static void
+lockregister(struct spinlock *lk)
+{
+  int i;
+
+  if(lk == &lock_locks)
+    return;
+  acquire(&lock_locks);
+  for(i = 0; i < NLOCK; i++){
+    if(locks[i] == 0 || locks[i] == lk){
+      locks[i] = lk;
+      break;
+    }
+  }
+  release(&lock_locks);
+  // 表满时该锁不出现在统计中
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->sleeplock = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->nspin = 0;
+  if(lock_locks.name == 0)
+    initlock(&lock_locks, "lock_locks");
+  lockregister(lk);
+}
+
+// Forget a lock whose memory is about to be freed.
+void
+freelock(struct spinlock *lk)
+{
+  int i;
+
+  acquire(&lock_locks);
+  for(i = 0; i < NLOCK; i++){
+    if(locks[i] == lk){
+      locks[i] = 0;
+      break;
+    }
+  }
+  release(&lock_locks);
 }
 
 // Acquire the lock.
 // Loops (spins) until the lock is acquired.
+// A ticket lock: CPUs get the lock in the order they asked for
+// it, and waiters only read owner until it is their turn.
 void
 acquire(struct spinlock *lk)
 {
+  uint t;
+  uint64 t0;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
-  //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  // On RISC-V, this turns into an atomic add:
+  //   amoadd.w a5, a4, (s1)
+  t = __sync_fetch_and_add(&lk->next, 1);
 
-  // Tell the C compiler and the processor to not move loads or stores
-  // past this point, to ensure that the critical section's memory
-  // references happen strictly after the lock is acquired.
-  // On RISC-V, this emits a fence instruction.
-  __sync_synchronize();
+  // __ATOMIC_ACQUIRE keeps the critical section's memory
+  // references from moving before the lock is acquired.
+  if(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != t){
+    t0 = r_time();
+    while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != t)
+      ;
+    lk->ncontend++;
+    lk->nspin += r_time() - t0;
+  }
+  lk->nacquire++;
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
@@ -51,22 +107,12 @@ release(struct spinlock *lk)
 
   lk->cpu = 0;
 
-  // Tell the C compiler and the CPU to not move loads or stores
-  // past this point, to ensure that all the stores in the critical
-  // section are visible to other CPUs before the lock is released,
-  // and that loads in the critical section occur strictly before
-  // the lock is released.
-  // On RISC-V, this emits a fence instruction.
-  __sync_synchronize();
-
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // Hand the lock to the next ticket. __ATOMIC_RELEASE makes
+  // all the stores in the critical section visible to other
+  // CPUs before the lock is released, and keeps loads in the
+  // critical section strictly before it; on RISC-V this emits
+  // a fence before the store. Only the holder writes owner.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
   pop_off();
 }
@@ -77,10 +123,165 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
   return r;
 }
 
+// Reader-writer locks.
+// Readers, like holders of a spinlock, keep interrupts off;
+// a CPU must not take the read lock twice, since a waiting
+// writer would deadlock it.
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  initlock(&rw->lk, name);
+  rw->readers = 0;
+}
+
+void
+acquireread(struct rwlock *rw)
+{
+  push_off();
+  // 写者按ticket顺序排队，读者也经过lk，因此不会饿死写者
+  acquire(&rw->lk);
+  __sync_fetch_and_add(&rw->readers, 1);
+  release(&rw->lk);
+}
+
+void
+releaseread(struct rwlock *rw)
+{
+  // 临界区内的读操作不能移到计数减一之后
+  __atomic_fetch_sub(&rw->readers, 1, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+void
+acquirewrite(struct rwlock *rw)
+{
+  acquire(&rw->lk);
+  while(__atomic_load_n(&rw->readers, __ATOMIC_ACQUIRE) != 0)
+    ;
+}
+
+void
+releasewrite(struct rwlock *rw)
+{
+  release(&rw->lk);
+}
+
+int
+holdingwrite(struct rwlock *rw)
+{
+  return holding(&rw->lk);
+}
+
+// Sequence locks.
+// A reader loops:
+//   do {
+//     seq = readseqbegin(sl);
+//     ... copy the protected fields ...
+//   } while(readseqretry(sl, seq));
+// The protected fields must be plain data that is safe to
+// read while torn, since the copy may be discarded.
+
+void
+initseqlock(struct seqlock *sl, char *name)
+{
+  initlock(&sl->lk, name);
+  sl->seq = 0;
+}
+
+void
+writeseqlock(struct seqlock *sl)
+{
+  acquire(&sl->lk);
+  sl->seq++;
+  __sync_synchronize();
+}
+
+void
+writesequnlock(struct seqlock *sl)
+{
+  __sync_synchronize();
+  sl->seq++;
+  release(&sl->lk);
+}
+
+uint
+readseqbegin(struct seqlock *sl)
+{
+  uint seq;
+
+  while((seq = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+    ;  // 写者正在更新
+  return seq;
+}
+
+int
+readseqretry(struct seqlock *sl, uint seq)
+{
+  __sync_synchronize();
+  return sl->seq != seq;
+}
+
+// A sleep lock is listed with the statistics of acquiresleep()
+// rather than those of its inner spinlock.
+static uint64
+ncontended(struct spinlock *lk)
+{
+  return lk->sleeplock ? lk->sleeplock->ncontend : lk->ncontend;
+}
+
+// Copy statistics of the max most contended locks to user
+// address addr, most contended first. Returns the number copied.
+int
+lockstat(uint64 addr, int max)
+{
+  static struct spinlock *top[NLOCK];
+  struct lockinfo li;
+  struct spinlock *lk;
+  int i, j, n = 0;
+
+  acquire(&lock_locks);
+  // 按ncontend插入排序；lock_locks同时保护top[]
+  for(i = 0; i < NLOCK; i++){
+    if((lk = locks[i]) == 0 || lk->nacquire == 0)
+      continue;
+    for(j = n; j > 0 && ncontended(top[j-1]) < ncontended(lk); j--)
+      top[j] = top[j-1];
+    top[j] = lk;
+    n++;
+  }
+  if(n > max)
+    n = max;
+  for(i = 0; i < n; i++){
+    lk = top[i];
+    safestrcpy(li.name, lk->name, sizeof(li.name));
+    if(lk->sleeplock){
+      li.sleeplock = 1;
+      li.nacquire = lk->sleeplock->nacquire;
+      li.ncontend = lk->sleeplock->ncontend;
+      li.nsleep = lk->sleeplock->nsleep;
+      li.nspin = lk->sleeplock->waittime;
+    } else {
+      li.sleeplock = 0;
+      li.nacquire = lk->nacquire;
+      li.ncontend = lk->ncontend;
+      li.nsleep = 0;
+      li.nspin = lk->nspin;
+    }
+    // copyout可能获取其他锁，但不会获取lock_locks
+    if(copyout(myproc()->pagetable, addr + i*sizeof(li), (char*)&li, sizeof(li)) < 0){
+      n = -1;
+      break;
+    }
+  }
+  release(&lock_locks);
+  return n;
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -1,9 +1,29 @@
 // Mutual exclusion lock.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket now allowed to hold the lock.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  struct sleeplock *sleeplock; // The sleep lock this lock is part of, or 0.
+
+  // 竞争统计，持锁时更新，由lockstat()读出
+  uint64 nacquire;   // acquire()次数
+  uint64 ncontend;   // 需要等待的acquire()次数
+  uint64 nspin;      // 等待的时间(time CSR)
+};
+
+// Reader-writer spin lock. Readers share it; a writer waits for
+// readers to drain and keeps new readers out while it waits.
+struct rwlock {
+  uint readers;        // CPUs holding the lock for reading
+  struct spinlock lk;  // held by the writer; readers hold it only to enter
 };
 
+// Sequence lock. Writers are serialized by lk; readers take no
+// lock and retry if seq changed under them.
+struct seqlock {
+  uint seq;            // odd while a writer is updating
+  struct spinlock lk;
+};
@@ -41,6 +41,10 @@ start()
   // ask for clock interrupts.
   timerinit();
 
+  // let supervisor mode read the time CSR, so that
+  // clockintr() can derive ticks from it.
+  w_mcounteren(r_mcounteren() | 2);
+
   // keep each CPU's hartid in its tp register, for cpuid().
   int id = r_mhartid();
   w_tp(id);
@@ -60,7 +64,7 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
+  int interval = TICKCYCLES; // cycles; see param.h.
   *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
 
   // prepare information in scratch[] for timervec.
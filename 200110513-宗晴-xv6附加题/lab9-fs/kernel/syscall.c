@@ -105,6 +105,11 @@ extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
 extern uint64 sys_symlink(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_getprocs(void);
+extern uint64 sys_nanosleep(void);
+extern uint64 sys_uptime_ns(void);
+extern uint64 sys_lockstat(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -129,6 +134,11 @@ static uint64 (*syscalls[])(void) = {
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
 [SYS_symlink] sys_symlink,
+[SYS_setpriority] sys_setpriority,
+[SYS_getprocs] sys_getprocs,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_uptime_ns] sys_uptime_ns,
+[SYS_lockstat] sys_lockstat,
 };
 
 void
@@ -317,12 +317,14 @@ sys_open(void)
         return -1;
       }
       // 跟随符号链接，直到跟随到非符号链接的inode为止
+      // 较短的目标路径内联在inode中，readi无需读取数据块
       if(ip->type == T_SYMLINK && (omode & O_NOFOLLOW) == 0) {
-        if(readi(ip, 0, (uint64)path, 0, MAXPATH) < 0) {
+        if((n = readi(ip, 0, (uint64)path, 0, MAXPATH-1)) < 0) {
           iunlockput(ip);
           end_op();
           return -1;
         }
+        path[n] = 0;
       } else break;
       iunlockput(ip);
     }
@@ -56,21 +56,24 @@ uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if(n <= 0)
+    return 0;
+  return sleepuntil(r_time() + (uint64)n * TICKCYCLES);
+}
+
+// sleep for the given number of nanoseconds, with the
+// resolution of the time CSR rather than of clock ticks.
+uint64
+sys_nanosleep(void)
+{
+  uint64 ns;
+
+  if(argaddr(0, &ns) < 0)
+    return -1;
+  return sleepuntil(r_time() + ns / (1000000000 / TIMEBASE));
 }
 
 uint64
@@ -95,3 +98,42 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+// return how many nanoseconds have passed since start.
+uint64
+sys_uptime_ns(void)
+{
+  return r_time() * (1000000000 / TIMEBASE);
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  if(argint(0, &pid) < 0 || argint(1, &prio) < 0)
+    return -1;
+  return setpriority(pid, prio);
+}
+
+uint64
+sys_getprocs(void)
+{
+  uint64 addr;
+  int max;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &max) < 0)
+    return -1;
+  return getprocs(addr, max);
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int max;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &max) < 0)
+    return -1;
+  return lockstat(addr, max);
+}
@@ -9,6 +9,9 @@
 struct spinlock tickslock;
 uint ticks;
 
+// scratch[4] of each hart's area is its timer interval, see start.c.
+extern uint64 timer_scratch[NCPU][5];
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -76,8 +79,9 @@ usertrap(void)
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this is a timer interrupt
+  // and the process has used up its time slice.
+  if(which_dev == 2 && proctick())
     yield();
 
   usertrapret();
@@ -149,8 +153,9 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  // give up the CPU if this is a timer interrupt
+  // and the process has used up its time slice.
+  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING && proctick())
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -159,15 +164,64 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// Called on every hart's timer interrupt, including the ones
+// timerarm() schedules for sleep deadlines. ticks is derived from
+// the time CSR rather than counted, so that it stays right while
+// idle harts skip interrupts; the first hart to see a new tick
+// updates it. Sleepers are woken by timerexpire() at their own
+// deadlines, not on every tick.
 void
 clockintr()
 {
+  uint now = r_time() / TICKCYCLES;
+
+  timerexpire();
+
+  if(now == ticks)
+    return;  // 本tick已由其他hart处理
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  if((int)(now - ticks) > 0)
+    ticks = now;
   release(&tickslock);
 }
 
+// Program this hart's timer interval: an idle hart skips up to
+// IDLETICKS ticks. Sleep deadlines are not affected, since
+// timerarm() programs them directly. Going idle takes effect
+// from the next timer interrupt; leaving idle also pulls that
+// interrupt in to one tick from now, so a hart that just found
+// work is preempted on time.
+// Caller must have interrupts disabled, as for timerarm().
+void
+timeridle(int idle)
+{
+  timer_scratch[cpuid()][4] = (idle ? IDLETICKS : 1) * TICKCYCLES;
+  if(!idle)
+    timerarm(r_time() + TICKCYCLES);
+}
+
+// Make this hart's next timer interrupt happen no later than
+// time when (in time CSR units). timervec in kernelvec.S adds
+// the interval to MTIMECMP from there on, so regular ticks
+// continue after it.
+// Caller must have interrupts disabled, so that cpuid() stays
+// valid. That does not keep out machine-mode timervec, which may
+// fire between the read and the store below and move MTIMECMP
+// past when. It only fires once the old MTIMECMP has passed,
+// which is then below when, so the store is skipped. The
+// software interrupt timervec raises is taken as soon as the
+// caller re-enables interrupts, and clockintr()'s timerexpire()
+// re-arms the heap's earliest deadline. So the deadline is late
+// by at most that interrupt's latency, not by up to IDLETICKS.
+void
+timerarm(uint64 when)
+{
+  volatile uint64 *cmp = (uint64*)CLINT_MTIMECMP(cpuid());
+
+  if(when < *cmp)
+    *cmp = when;
+}
+
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
@@ -204,10 +258,8 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
+    clockintr();
+
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
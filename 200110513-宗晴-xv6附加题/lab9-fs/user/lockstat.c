@@ -0,0 +1,36 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/lockinfo.h"
+#include "user/user.h"
+
+// lockstat [n]
+// 列出竞争最多的n个锁，默认10个
+int
+main(int argc, char *argv[])
+{
+  static struct lockinfo ls[NLOCK];
+  int i, n, max = 10;
+
+  if(argc > 1 && (max = atoi(argv[1])) <= 0){
+    fprintf(2, "usage: lockstat [n]\n");
+    exit(1);
+  }
+  if(max > NLOCK)
+    max = NLOCK;
+  if((n = lockstat(ls, max)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+  printf("NAME\t\tACQUIRE\tCONTEND\tSLEEP\tWAIT(us)\n");
+  for(i = 0; i < n; i++){
+    // printf不支持64位整数，计数按int输出；自旋锁没有SLEEP一栏
+    printf("%s\t%s%d\t%d\t", ls[i].name, strlen(ls[i].name) < 8 ? "\t" : "",
+           (int)ls[i].nacquire, (int)ls[i].ncontend);
+    if(ls[i].sleeplock)
+      printf("%d\t", (int)ls[i].nsleep);
+    else
+      printf("-\t");
+    printf("%d\n", (int)(ls[i].nspin / (TIMEBASE / 1000000)));
+  }
+  exit(0);
+}
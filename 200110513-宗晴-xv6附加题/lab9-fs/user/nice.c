@@ -0,0 +1,20 @@
+#include "kernel/types.h"
+#include "user/user.h"
+
+// nice prio cmd [args...]
+// 以MLFQ级别prio运行cmd，0级优先级最高
+int
+main(int argc, char *argv[])
+{
+  if(argc < 3){
+    fprintf(2, "usage: nice prio cmd [args...]\n");
+    exit(1);
+  }
+  if(setpriority(getpid(), atoi(argv[1])) < 0){
+    fprintf(2, "nice: bad priority %s\n", argv[1]);
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "nice: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,27 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/procinfo.h"
+#include "user/user.h"
+
+// 与kernel/proc.h中的enum procstate对应
+static char *states[] = {
+  "unused", "sleep ", "runble", "run   ", "zombie"
+};
+
+int
+main(int argc, char *argv[])
+{
+  struct procinfo ps[NPROC];
+  int i, n;
+
+  if((n = getprocs(ps, NPROC)) < 0){
+    fprintf(2, "ps: getprocs failed\n");
+    exit(1);
+  }
+  printf("PID\tPRIO\tBASE\tSTATE\tTICKS\tNAME\n");
+  for(i = 0; i < n; i++){
+    printf("%d\t%d\t%d\t%s\t%d\t%s\n", ps[i].pid, ps[i].prio, ps[i].baseprio,
+           states[ps[i].state], ps[i].rtime, ps[i].name);
+  }
+  exit(0);
+}
@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct procinfo;
+struct lockinfo;
 
 // system calls
 int fork(void);
@@ -24,6 +26,11 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int symlink(char *, char *);
+int setpriority(int, int);
+int getprocs(struct procinfo*, int);
+int nanosleep(uint64);
+uint64 uptime_ns(void);
+int lockstat(struct lockinfo*, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -36,4 +36,9 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
-entry("symlink");
\ No newline at end of file
+entry("symlink");
+entry("setpriority");
+entry("getprocs");
+entry("nanosleep");
+entry("uptime_ns");
+entry("lockstat");
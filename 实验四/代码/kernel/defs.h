@@ -164,7 +164,6 @@ pagetable_t     kvminit_new();  // 初始化内核独立页表
 void            kvminithart(void);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
-void            kvmmap_new(pagetable_t, uint64, uint64, uint64, int);  // 为内核独立页表pagetable_t增加映射
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
@@ -183,7 +182,7 @@ int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
 int             test_pagetable();
 void            vmprint(pagetable_t);  // 添加页表打印函数的声明
-void            vmshare(pagetable_t, pagetable_t); // 内核页表共享用户页表
+void            vmshare(pagetable_t, pagetable_t, uint64, uint64); // 内核页表共享用户页表[start, end)部分
 
 // vmcopyin.c
 int             copyin_new(pagetable_t, char *, uint64, uint64);
@@ -70,6 +70,8 @@ exec(char *path, char **argv)
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
+  if(sz + 2*PGSIZE > PLIC)
+    goto bad;
   if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   sz = sz1;
@@ -116,10 +118,11 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
 
-  // 内核页表共享用户页表
-  vmshare(p->pagetable, p->k_pagetable);
+  // 内核页表共享用户页表；须在释放旧页表之前，
+  // 并清除旧映像超出新映像的部分
+  vmshare(p->pagetable, p->k_pagetable, 0, sz > oldsz ? sz : oldsz);
+  proc_freepagetable(oldpagetable, oldsz);
 
   // 打印页表信息
   if(p->pid==1) vmprint(p->pagetable);
@@ -38,9 +38,8 @@ procinit(void)
       if(pa == 0)
         panic("kalloc");
       uint64 va = KSTACK((int) (p - proc));
-      kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);  // 保留内核栈在全局页表kernel_pagetable的映射
+      kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);  // 进程的内核独立页表共享这一映射
       p->kstack = va;
-      p->kstack_pa = (uint64)pa;  // 内核栈的物理地址
   }
   kvminithart();
 }
@@ -128,15 +127,13 @@ found:
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
 
-  // 创建每个进程的内核独立页表
+  // 创建每个进程的内核独立页表，其中已包含内核栈的映射
   p->k_pagetable = kvminit_new();
   if(p->k_pagetable == 0){
     freeproc(p);
     release(&p->lock);
     return 0;
   }
-  // 将kstack到kstack_pa的映射保存到内核独立页表中
-  kvmmap_new(p->k_pagetable, (uint64)p->kstack, p->kstack_pa, PGSIZE, PTE_R | PTE_W);
 
   return p;
 }
@@ -162,18 +159,12 @@ freeproc(struct proc *p)
   p->xstate = 0;
   p->state = UNUSED;
 
-  // 将内核页表的前96项置零，避免重复回收
-  uint64 k_pgtbl_pa = PTE2PA(p->k_pagetable[0]);
-  for (int i = 0; i < 96; i++) {
-    ((pagetable_t)k_pgtbl_pa)[i] = 0;
-  }
-
   // 回收内核页表
   if(p->k_pagetable)
     proc_free_k_pagetable(p->k_pagetable);
   p->k_pagetable = 0;
 
-  // kstack和kstack_pa不能释放，因为它们都是在procinit()中被初始化的，只在启动的时候执行
+  // kstack不能释放，因为它是在procinit()中被初始化的，只在启动的时候执行
 }
 
 
@@ -221,23 +212,13 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
   uvmfree(pagetable, sz);
 }
 
-// Free a process's kernel page table
+// Free a process's kernel page table.
+// Only the two pages made by kvminit_new() are its own; the
+// user's and the kernel's page-table pages it points to are not.
 void
 proc_free_k_pagetable(pagetable_t k_pagetable)
 {
-  // there are 2^9 = 512 PTEs in a page table.
-  for(int i = 0; i < 512; i++){
-    pte_t pte = k_pagetable[i];
-    if((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0){
-    // 页表项有效，且不是叶子页表，则递归释放其页表项指向的页表
-      uint64 child = PTE2PA(pte);
-      proc_free_k_pagetable((pagetable_t)child);
-      k_pagetable[i] = 0;
-    } else if(pte & PTE_V){
-    // 页表项有效，且是叶子页表，则不用释放其页表项指向的物理页帧
-      k_pagetable[i] = 0;  
-    }
-  }
+  kfree((void*)PTE2PA(k_pagetable[0]));
   kfree((void*)k_pagetable);
 }
 
@@ -277,7 +258,7 @@ userinit(void)
   p->state = RUNNABLE;
 
   // 内核页表共享用户页表
-  vmshare(p->pagetable, p->k_pagetable);
+  vmshare(p->pagetable, p->k_pagetable, 0, p->sz);
 
   release(&p->lock);
 }
@@ -292,17 +273,19 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
+    if(sz + n > PLIC)  // 用户空间不能进入内核页表中PLIC的映射
+      return -1;
     if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
       return -1;
     }
+    // 只同步新增部分；新的叶子页表只可能出现在这里
+    vmshare(p->pagetable, p->k_pagetable, p->sz, sz);
   } else if(n < 0){
+    // uvmdealloc()不释放叶子页表，共享的次级页表项仍然有效，无需同步
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
 
-  // 内核页表共享用户页表
-  vmshare(p->pagetable, p->k_pagetable);
-
   return 0;
 }
 
@@ -349,7 +332,7 @@ fork(void)
   np->state = RUNNABLE;
 
   // 内核页表共享用户页表
-  vmshare(np->pagetable, np->k_pagetable);
+  vmshare(np->pagetable, np->k_pagetable, 0, np->sz);
 
   release(&np->lock);
 
@@ -104,5 +104,4 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   pagetable_t k_pagetable;     // 每个进程的内核独立页表
-  uint64 kstack_pa;            // 每个进程的内核栈的物理地址
 };
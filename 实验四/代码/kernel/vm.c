@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -15,6 +17,11 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[]; // trampoline.S
 
+// number of level-1 PTEs under root entry 0 that cover user
+// memory, which lies below PLIC; the rest of a proc's kernel
+// page table is shared with kernel_pagetable.
+#define NUSERPTE PX(1, PLIC)
+
 /*
  * create a direct-map page table for the kernel.
  */
@@ -48,34 +55,34 @@ kvminit()
 }
 
 /*
- * create a  new direct-map page table for the kernel for each proc.
+ * create a kernel page table for a proc from kernel_pagetable.
+ * only two pages are private: the root, and the level-1 table
+ * under root entry 0, whose first NUSERPTE entries vmshare()
+ * fills with the user's mappings. all other entries point to
+ * kernel_pagetable's subtrees, including every kernel stack
+ * mapped by procinit().
+ * returns 0 if out of memory.
  */
 pagetable_t
 kvminit_new()
 {
-  pagetable_t k_pagetable = (pagetable_t) kalloc();
-  memset(k_pagetable, 0, PGSIZE);
-
-  // uart registers
-  kvmmap_new(k_pagetable, UART0, UART0, PGSIZE, PTE_R | PTE_W);
-
-  // virtio mmio disk interface
-  kvmmap_new(k_pagetable, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
-
-  // 此处不映射CLINT
-
-  // PLIC
-  kvmmap_new(k_pagetable, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
+  pagetable_t k_pagetable, l1;
 
-  // map kernel text executable and read-only.
-  kvmmap_new(k_pagetable, KERNBASE, KERNBASE, (uint64)etext-KERNBASE, PTE_R | PTE_X);
+  if((k_pagetable = (pagetable_t) kalloc()) == 0)
+    return 0;
+  if((l1 = (pagetable_t) kalloc()) == 0){
+    kfree(k_pagetable);
+    return 0;
+  }
 
-  // map kernel data and the physical RAM we'll make use of.
-  kvmmap_new(k_pagetable, (uint64)etext, (uint64)etext, PHYSTOP-(uint64)etext, PTE_R | PTE_W);
+  // 顶级页表项直接指向全局页表的子树，共享而不复制
+  memmove(k_pagetable, kernel_pagetable, PGSIZE);
 
-  // map the trampoline for trap entry/exit to
-  // the highest virtual address in the kernel.
-  kvmmap_new(k_pagetable, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
+  // UART、VIRTIO和PLIC仍共享全局页表的叶子页表；
+  // 用户空间部分清零，因此也不映射其中的CLINT
+  memmove(l1, (void*)PTE2PA(kernel_pagetable[0]), PGSIZE);
+  memset(l1, 0, NUSERPTE * sizeof(pte_t));
+  k_pagetable[0] = PA2PTE(l1) | PTE_V;
 
   return k_pagetable;  // 返回该内核独立页表的地址
 }
@@ -154,16 +161,6 @@ kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
     panic("kvmmap");
 }
 
-// add a mapping to the kernel page table for each proc.
-// only used when booting.
-// does not flush TLB or enable paging.
-void
-kvmmap_new(pagetable_t pagetable, uint64 va, uint64 pa, uint64 sz, int perm)
-{
-  if(mappages(pagetable, va, sz, pa, perm) != 0)
-    panic("kvmmap");
-}
-
 
 // translate a kernel virtual address to
 // a physical address. only needed for
@@ -393,107 +390,159 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
-// Copy from kernel to user.
-// Copy len bytes from src to virtual address dstva in a given page table.
+// Copy n bytes, 8 at a time when dst and src are equally aligned.
+// dst and src must not overlap.
+static void
+copywords(char *dst, const char *src, uint64 n)
+{
+  if(((uint64)dst & 7) == ((uint64)src & 7)){
+    while(n > 0 && ((uint64)dst & 7)){
+      *dst++ = *src++;
+      n--;
+    }
+    for(; n >= 8; n -= 8, dst += 8, src += 8)
+      *(uint64*)dst = *(const uint64*)src;
+  }
+  while(n-- > 0)
+    *dst++ = *src++;
+}
+
+// Copy len bytes between virtual address uva in a given page table
+// and kernel address kva: to the kernel if tokernel, else to user.
+// Each leaf page-table page is walked once rather than once per
+// page, and physically contiguous pages are copied as one run.
 // Return 0 on success, -1 on error.
-int
-copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
+static int
+copyuser(pagetable_t pagetable, uint64 uva, char *kva, uint64 len, int tokernel)
 {
-  uint64 n, va0, pa0;
+  pte_t *pte = 0;
+  uint64 n, va0, pa, runpa = 0, runlen = 0;
+
+  if(uva + len < uva || uva + len > MAXVA)
+    return -1;
 
   while(len > 0){
-    va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    va0 = PGROUNDDOWN(uva);
+    // 同一叶子页表中的下一页直接取下一个页表项
+    if(pte == 0 || PX(0, va0) == 0){
+      if((pte = walk(pagetable, va0, 0)) == 0)
+        return -1;
+    } else {
+      pte++;
+    }
+    if((*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U))
       return -1;
-    n = PGSIZE - (dstva - va0);
+    pa = PTE2PA(*pte) + (uva - va0);
+    n = PGSIZE - (uva - va0);
     if(n > len)
       n = len;
-    memmove((void *)(pa0 + (dstva - va0)), src, n);
+
+    // 物理地址不连续时先拷贝已累积的部分
+    if(runlen > 0 && pa != runpa + runlen){
+      if(tokernel)
+        copywords(kva, (char *)runpa, runlen);
+      else
+        copywords((char *)runpa, kva, runlen);
+      kva += runlen;
+      runlen = 0;
+    }
+    if(runlen == 0)
+      runpa = pa;
+    runlen += n;
 
     len -= n;
-    src += n;
-    dstva = va0 + PGSIZE;
+    uva = va0 + PGSIZE;
   }
+  if(tokernel)
+    copywords(kva, (char *)runpa, runlen);
+  else
+    copywords((char *)runpa, kva, runlen);
   return 0;
 }
 
+// Copy from kernel to user.
+// Copy len bytes from src to virtual address dstva in a given page table.
+// Return 0 on success, -1 on error.
+int
+copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
+{
+  // 不通过内核独立页表直接写：exec()设置的栈保护页在其中仍可写
+  return copyuser(pagetable, dstva, src, len, 0);
+}
+
 // Copy from user to kernel.
 // Copy len bytes to dst from virtual address srcva in a given page table.
 // Return 0 on success, -1 on error.
 int
 copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len)
 {
-  w_sstatus(r_sstatus() | SSTATUS_SUM);
-  int r = copyin_new(pagetable, dst, srcva, len);
-  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
-  return r;
-
-  // uint64 n, va0, pa0;
-
-  // while(len > 0){
-  //   va0 = PGROUNDDOWN(srcva);
-  //   pa0 = walkaddr(pagetable, va0);
-  //   if(pa0 == 0)
-  //     return -1;
-  //   n = PGSIZE - (srcva - va0);
-  //   if(n > len)
-  //     n = len;
-  //   memmove(dst, (void *)(pa0 + (srcva - va0)), n);
-
-  //   len -= n;
-  //   dst += n;
-  //   srcva = va0 + PGSIZE;
-  // }
-  // return 0;
+  struct proc *p = myproc();
+
+  // 当前进程的内核独立页表共享了用户页表时，直接按用户虚拟地址读取
+  if(p && pagetable == p->pagetable && test_pagetable() &&
+     srcva + len >= srcva && srcva + len <= p->sz){
+    w_sstatus(r_sstatus() | SSTATUS_SUM);
+    copywords(dst, (char *)srcva, len);
+    w_sstatus(r_sstatus() & ~SSTATUS_SUM);
+    return 0;
+  }
+  return copyuser(pagetable, srcva, dst, len, 1);
 }
 
+// true if some byte of the 64-bit word w is zero.
+#define HASZERO(w) (((w) - 0x0101010101010101ULL) & ~(w) & 0x8080808080808080ULL)
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
+// Scans and copies 8 bytes at a time, and, like copyuser(),
+// walks each leaf page-table page only once.
 // Return 0 on success, -1 on error.
 int
 copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max)
 {
-  w_sstatus(r_sstatus() | SSTATUS_SUM);
-  int r = copyinstr_new(pagetable, dst, srcva, max);
-  w_sstatus(r_sstatus() & ~SSTATUS_SUM);
-  return r;
-
-  // uint64 n, va0, pa0;
-  // int got_null = 0;
-
-  // while(got_null == 0 && max > 0){
-  //   va0 = PGROUNDDOWN(srcva);
-  //   pa0 = walkaddr(pagetable, va0);
-  //   if(pa0 == 0)
-  //     return -1;
-  //   n = PGSIZE - (srcva - va0);
-  //   if(n > max)
-  //     n = max;
-
-  //   char *p = (char *) (pa0 + (srcva - va0));
-  //   while(n > 0){
-  //     if(*p == '\0'){
-  //       *dst = '\0';
-  //       got_null = 1;
-  //       break;
-  //     } else {
-  //       *dst = *p;
-  //     }
-  //     --n;
-  //     --max;
-  //     p++;
-  //     dst++;
-  //   }
-
-  //   srcva = va0 + PGSIZE;
-  // }
-  // if(got_null){
-  //   return 0;
-  // } else {
-  //   return -1;
-  // }
+  pte_t *pte = 0;
+  uint64 n, va0, w;
+  char *s;
+
+  while(max > 0){
+    va0 = PGROUNDDOWN(srcva);
+    if(pte == 0 || PX(0, va0) == 0){
+      if(va0 >= MAXVA || (pte = walk(pagetable, va0, 0)) == 0)
+        return -1;
+    } else {
+      pte++;
+    }
+    if((*pte & (PTE_V | PTE_U)) != (PTE_V | PTE_U))
+      return -1;
+    s = (char *)(PTE2PA(*pte) + (srcva - va0));
+    n = PGSIZE - (srcva - va0);
+    if(n > max)
+      n = max;
+    max -= n;
+
+    // 先逐字节对齐源地址，对齐的8字节读不会跨页
+    for(; n > 0 && ((uint64)s & 7); n--){
+      if((*dst++ = *s++) == '\0')
+        return 0;
+    }
+    for(; n >= 8; n -= 8, s += 8, dst += 8){
+      w = *(uint64 *)s;
+      if(HASZERO(w))
+        break;  // 该字中有'\0'，交给下面逐字节处理
+      if(((uint64)dst & 7) == 0)
+        *(uint64 *)dst = w;
+      else
+        memmove(dst, &w, 8);
+    }
+    for(; n > 0; n--){
+      if((*dst++ = *s++) == '\0')
+        return 0;
+    }
+
+    srcva = va0 + PGSIZE;
+  }
+  return -1;
 }
 
 // check if use global kpgtbl or not 
@@ -533,18 +582,28 @@ vmprint(pagetable_t pgtbl)
 }
 
 // 实现内核页表直接共享用户页表的叶子页表
-// 经计算，96个次级页表项就能涵盖整个用户地址空间
-// (计算过程见实验报告)
-// 所以只需将用户页表的96个次级页表项复制到内核页表中
-void vmshare(pagetable_t u_pgtbl, pagetable_t k_pgtbl) {
-  // 获取二级页表的起始物理地址
-  uint64 u_pgtbl_pa = PTE2PA(u_pgtbl[0]);
-  uint64 k_pgtbl_pa = PTE2PA(k_pgtbl[0]);
-
-  // 将用户页表的96个次级页表项复制到内核页表中
-  pte_t *p;
-  for (int i = 0; i < 96; i ++ ) {
-    p = &(((pagetable_t)k_pgtbl_pa)[i]);
-    *p = ((pagetable_t)u_pgtbl_pa)[i];
-  }
+// 用户空间位于PLIC之下，由顶级页表第0项下的前NUSERPTE个
+// 次级页表项涵盖(计算过程见实验报告)
+// 将用户页表中涵盖[start, end)的次级页表项复制到内核页表中，
+// 用户页表中没有的置零；叶子页表按指针共享，之后在已有
+// 叶子页表内的增删无需再同步
+void
+vmshare(pagetable_t u_pgtbl, pagetable_t k_pgtbl, uint64 start, uint64 end)
+{
+  pagetable_t u_l1 = 0, k_l1;
+  uint64 i, last;
+
+  if(end > PLIC)
+    panic("vmshare");
+  if(start >= end)
+    return;
+
+  // 用户页表可能还没有第0项(如尚未分配内存的新页表)
+  if(u_pgtbl[0] & PTE_V)
+    u_l1 = (pagetable_t)PTE2PA(u_pgtbl[0]);
+  k_l1 = (pagetable_t)PTE2PA(k_pgtbl[0]);
+
+  last = PX(1, end - 1);
+  for(i = PX(1, start); i <= last; i++)
+    k_l1[i] = u_l1 ? u_l1[i] : 0;
 }